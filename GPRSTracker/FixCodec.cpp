@@ -0,0 +1,251 @@
+// 
+// 
+// 
+
+#include "FixCodec.h"
+
+static uint32_t zigzag(int32_t value)
+{
+	return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static int32_t unzigzag(uint32_t value)
+{
+	return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+static size_t writeVarint(uint32_t value, uint8_t *buffer)
+{
+	size_t length = 0;
+	while (value >= 0x80)
+	{
+		buffer[length++] = (uint8_t)(value | 0x80);
+		value >>= 7;
+	}
+	buffer[length++] = (uint8_t)value;
+	return length;
+}
+
+// Returns 0 if the varint does not end before length bytes
+static size_t readVarint(const uint8_t *data, size_t length, uint32_t &value)
+{
+	value = 0;
+	for (size_t i = 0; i < length && i < 5; ++i)
+	{
+		value |= (uint32_t)(data[i] & 0x7F) << (7 * i);
+		if (!(data[i] & 0x80))
+		{
+			return i + 1;
+		}
+	}
+	return 0;
+}
+
+static size_t writeDelta(int32_t value, int32_t previous, uint8_t *buffer)
+{
+	// Unsigned subtraction, the difference of two far apart values wraps
+	return writeVarint(zigzag((int32_t)((uint32_t)value - (uint32_t)previous)), buffer);
+}
+
+static size_t readDelta(const uint8_t *data, size_t length, int32_t previous, int32_t &value)
+{
+	uint32_t encoded;
+	size_t read = readVarint(data, length, encoded);
+	value = (int32_t)((uint32_t)previous + (uint32_t)unzigzag(encoded));
+	return read;
+}
+
+FixRecord::FixRecord() :
+	flags(0),
+	lat(0),
+	lng(0),
+	time(0),
+	altitude(0),
+	speed(0),
+	course(0)
+{
+}
+
+FixEncoder::FixEncoder() :
+	hasAcknowledged(false)
+{
+}
+
+size_t FixEncoder::encode(const FixRecord &fix, uint8_t *buffer)
+{
+	// KEY records are relative to an all zero record
+	FixRecord zero;
+	const FixRecord &previous = hasAcknowledged ? acknowledged : zero;
+
+	pending = fix;
+	pending.flags &= ~FixRecord::KEY;
+	if (!hasAcknowledged)
+	{
+		pending.flags |= FixRecord::KEY;
+	}
+
+	size_t length = 0;
+	buffer[length++] = (FIX_CODEC_VERSION << 4) | pending.flags;
+
+	if (pending.flags & FixRecord::NO_POSITION)
+	{
+		return length;
+	}
+
+	length += writeDelta(fix.lat, previous.lat, buffer + length);
+	length += writeDelta(fix.lng, previous.lng, buffer + length);
+	length += writeDelta(fix.time, previous.time, buffer + length);
+
+	if (pending.flags & FixRecord::HAS_ALTITUDE)
+	{
+		length += writeDelta(fix.altitude, previous.altitude, buffer + length);
+	}
+
+	if (pending.flags & FixRecord::HAS_MOTION)
+	{
+		length += writeDelta(fix.speed, previous.speed, buffer + length);
+		length += writeDelta(fix.course, previous.course, buffer + length);
+	}
+
+	return length;
+}
+
+void FixEncoder::acknowledge()
+{
+	// A record without position does not move the reference
+	if (pending.flags & FixRecord::NO_POSITION)
+	{
+		return;
+	}
+
+	// Fields that were not sent keep their previous value on the receiver
+	if (!(pending.flags & FixRecord::HAS_ALTITUDE))
+	{
+		pending.altitude = hasAcknowledged ? acknowledged.altitude : 0;
+	}
+	if (!(pending.flags & FixRecord::HAS_MOTION))
+	{
+		pending.speed = hasAcknowledged ? acknowledged.speed : 0;
+		pending.course = hasAcknowledged ? acknowledged.course : 0;
+	}
+
+	acknowledged = pending;
+	hasAcknowledged = true;
+}
+
+void FixEncoder::reset()
+{
+	hasAcknowledged = false;
+}
+
+FixDecoder::FixDecoder() :
+	hasPrevious(false)
+{
+}
+
+size_t FixDecoder::decode(const uint8_t *data, size_t length, FixRecord &fix)
+{
+	if (length < 1 || (data[0] >> 4) != FIX_CODEC_VERSION)
+	{
+		return 0;
+	}
+
+	FixRecord decoded;
+	decoded.flags = data[0] & 0x0F;
+	size_t offset = 1;
+
+	if (decoded.flags & FixRecord::NO_POSITION)
+	{
+		fix = decoded;
+		return offset;
+	}
+
+	FixRecord zero;
+	if (!(decoded.flags & FixRecord::KEY) && !hasPrevious)
+	{
+		return 0;
+	}
+	const FixRecord &base = (decoded.flags & FixRecord::KEY) ? zero : previous;
+
+	int32_t value;
+	size_t read;
+
+	if (!(read = readDelta(data + offset, length - offset, base.lat, decoded.lat)))
+	{
+		return 0;
+	}
+	offset += read;
+
+	if (!(read = readDelta(data + offset, length - offset, base.lng, decoded.lng)))
+	{
+		return 0;
+	}
+	offset += read;
+
+	if (!(read = readDelta(data + offset, length - offset, base.time, value)))
+	{
+		return 0;
+	}
+	decoded.time = value;
+	offset += read;
+
+	decoded.altitude = base.altitude;
+	if (decoded.flags & FixRecord::HAS_ALTITUDE)
+	{
+		if (!(read = readDelta(data + offset, length - offset, base.altitude, decoded.altitude)))
+		{
+			return 0;
+		}
+		offset += read;
+	}
+
+	decoded.speed = base.speed;
+	decoded.course = base.course;
+	if (decoded.flags & FixRecord::HAS_MOTION)
+	{
+		if (!(read = readDelta(data + offset, length - offset, base.speed, value)))
+		{
+			return 0;
+		}
+		decoded.speed = value;
+		offset += read;
+
+		if (!(read = readDelta(data + offset, length - offset, base.course, value)))
+		{
+			return 0;
+		}
+		decoded.course = value;
+		offset += read;
+	}
+
+	previous = decoded;
+	hasPrevious = true;
+	fix = decoded;
+	return offset;
+}
+
+void FixDecoder::reset()
+{
+	hasPrevious = false;
+}
+
+size_t base64UrlEncode(const uint8_t *data, size_t length, char *out)
+{
+	static const char alphabet[] =
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+	size_t written = 0;
+	for (size_t i = 0; i < length; i += 3)
+	{
+		uint32_t group = (uint32_t)data[i] << 16;
+		if (i + 1 < length) group |= (uint32_t)data[i + 1] << 8;
+		if (i + 2 < length) group |= data[i + 2];
+
+		out[written++] = alphabet[(group >> 18) & 0x3F];
+		out[written++] = alphabet[(group >> 12) & 0x3F];
+		if (i + 1 < length) out[written++] = alphabet[(group >> 6) & 0x3F];
+		if (i + 2 < length) out[written++] = alphabet[group & 0x3F];
+	}
+	out[written] = '\0';
+	return written;
+}
@@ -0,0 +1,116 @@
+// FixCodec.h
+//
+// Compact binary format for uploaded fixes. This file and FixCodec.cpp do
+// not depend on Arduino so the server can build the same decoder.
+//
+// Every record starts with a header byte: the format version in the high
+// nibble and FixRecord flags in the low nibble. The fields follow as
+// zigzag varints holding the difference from the previous record, in this
+// order: lat, lng, time, altitude (HAS_ALTITUDE), speed and course
+// (HAS_MOTION). A KEY record is relative to an all zero record, so it can
+// be decoded without history. NO_POSITION records carry only the header.
+
+#ifndef _FIXCODEC_h
+#define _FIXCODEC_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+const uint8_t FIX_CODEC_VERSION = 1;
+
+// Worst case size of one encoded record
+const size_t FIX_RECORD_MAX_SIZE = 1 + 4 * 5 + 2 * 2;
+
+struct FixRecord
+{
+	enum Flags {
+		KEY = 0x1,
+		HAS_ALTITUDE = 0x2,
+		HAS_MOTION = 0x4,
+		NO_POSITION = 0x8
+	};
+
+	uint8_t flags;
+	// Ten millionths of a degree
+	int32_t lat;
+	int32_t lng;
+	// Seconds since 1970-01-01 UTC
+	uint32_t time;
+	// Meters above sea level
+	int32_t altitude;
+	// km/h, saturated at 255
+	uint8_t speed;
+	// Units of 2 degrees, 0 to 179
+	uint8_t course;
+
+	FixRecord();
+};
+
+/**
+ * Encodes records as differences from the last acknowledged record. A
+ * failed upload is ambiguous, the receiver may have decoded it anyway and
+ * moved its base past the acknowledged record. reset() must be called after
+ * every failed upload so the next record is a KEY record.
+ */
+class FixEncoder
+{
+ public:
+	FixEncoder();
+
+	/**
+	 * Writes fix into buffer, which must hold FIX_RECORD_MAX_SIZE bytes.
+	 * Returns the number of bytes written
+	 */
+	size_t encode(const FixRecord &fix, uint8_t *buffer);
+
+	/**
+	 * Marks the last encoded record as received, following records are
+	 * relative to it. Only to be called once the receiver confirmed it
+	 * decoded the record, any other answer is a failed upload
+	 */
+	void acknowledge();
+
+	/**
+	 * Forgets the history, so the next record is a KEY record
+	 */
+	void reset();
+
+ private:
+	FixRecord acknowledged;
+	FixRecord pending;
+	bool hasAcknowledged;
+};
+
+/**
+ * Decodes a sequence of records produced by FixEncoder
+ */
+class FixDecoder
+{
+ public:
+	FixDecoder();
+
+	/**
+	 * Decodes one record from data into fix. Returns the number of bytes
+	 * consumed, or 0 if the record is truncated, has an unknown version or
+	 * is a delta with no previous record
+	 */
+	size_t decode(const uint8_t *data, size_t length, FixRecord &fix);
+
+	/**
+	 * Forgets the previous record
+	 */
+	void reset();
+
+ private:
+	FixRecord previous;
+	bool hasPrevious;
+};
+
+/**
+ * Writes data as unpadded base64url into out, which must hold
+ * (4 * length + 2) / 3 + 1 chars. Returns the length of the string
+ */
+size_t base64UrlEncode(const uint8_t *data, size_t length, char *out);
+
+#endif
+
@@ -0,0 +1,93 @@
+// 
+// 
+// 
+
+#include "FixFilter.h"
+#include "GeoMath.h"
+
+// Speed limits beyond this many meters are not checked, farther points
+// do not fit the local projection
+const unsigned long MAX_CHECKED_DISTANCE = 10000;
+
+// Fixes more than an hour apart are not checked, also keeps the limit
+// computation from overflowing
+const unsigned long MAX_CHECKED_INTERVAL = 3600000UL;
+
+FixFilter::FixFilter(unsigned int maxHdop, uint8_t minSatellites, unsigned int maxSpeed, unsigned long maxAge) :
+	maxHdop(maxHdop),
+	minSatellites(minSatellites),
+	maxSpeed(maxSpeed),
+	maxAge(maxAge),
+	hasLastFix(false),
+	lastLat(0),
+	lastLng(0),
+	lastCosLat(0),
+	lastTime(0),
+	jumps(0)
+{
+}
+
+FixFilter::Result FixFilter::check(const TinyGPSFix &fix)
+{
+	if (fix.isValid(TinyGPSFix::HDOP) && fix.hdop > (int32_t)maxHdop)
+	{
+		return HIGH_HDOP;
+	}
+
+	if (fix.isValid(TinyGPSFix::SATELLITES) && fix.satellites < minSatellites)
+	{
+		return FEW_SATELLITES;
+	}
+
+	int32_t lat = GeoMath::toE7(fix.rawLat);
+	int32_t lng = GeoMath::toE7(fix.rawLng);
+
+	if (hasLastFix && isJump(fix, lat, lng) && ++jumps < MAX_JUMPS)
+	{
+		return JUMP;
+	}
+
+	lastCosLat = GeoMath::cosLatQ15(lat);
+	lastLat = lat;
+	lastLng = lng;
+	lastTime = fix.commitTime;
+	hasLastFix = true;
+	jumps = 0;
+	return ACCEPTED;
+}
+
+bool FixFilter::isStale(const TinyGPSFix &fix) const
+{
+	return millis() - fix.commitTime > maxAge;
+}
+
+bool FixFilter::isJump(const TinyGPSFix &fix, int32_t lat, int32_t lng) const
+{
+	unsigned long elapsed = fix.commitTime - lastTime;
+	if (elapsed > MAX_CHECKED_INTERVAL)
+	{
+		return false;
+	}
+
+	// km/h * ms / 3600 is meters
+	unsigned long limit = MIN_JITTER + maxSpeed * elapsed / 3600;
+	if (fix.isValid(TinyGPSFix::HDOP))
+	{
+		limit += METERS_PER_HDOP * fix.hdop / 100;
+	}
+	if (limit >= MAX_CHECKED_DISTANCE)
+	{
+		return false;
+	}
+
+	// Points outside the projection are more than MAX_CHECKED_DISTANCE
+	// apart below 70 degrees of latitude
+	int16_t north, east;
+	if (!GeoMath::localOffset(lastLat, lastLng, lat, lng, lastCosLat, north, east))
+	{
+		return true;
+	}
+
+	uint32_t distance2 = (int32_t)north * north + (int32_t)east * east;
+	return distance2 > limit * limit;
+}
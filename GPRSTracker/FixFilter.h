@@ -0,0 +1,82 @@
+// FixFilter.h
+
+#ifndef _FIXFILTER_h
+#define _FIXFILTER_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+	#include "Arduino.h"
+#else
+	#include "WProgram.h"
+#endif
+
+#include "TinyGPS++.h"
+
+/**
+ * Plausibility checks applied to fixes before they reach the report
+ * policy. Rejects fixes with a poor HDOP or too few satellites, and
+ * positions that would need an impossible speed to be reached from the
+ * last accepted fix. All the math is done in integers.
+ *
+ * Fixes are checked as they are committed, so their age is checked
+ * separately with isStale() where a kept fix is used later.
+ */
+class FixFilter
+{
+ public:
+	enum Result {
+		ACCEPTED,
+		HIGH_HDOP,
+		FEW_SATELLITES,
+		JUMP
+	};
+
+	/**
+	 * maxHdop is HDOP * 100, maxSpeed is in km/h and maxAge in
+	 * milliseconds. HDOP and satellites are only checked when the receiver
+	 * reported them
+	 */
+	FixFilter(unsigned int maxHdop, uint8_t minSatellites, unsigned int maxSpeed, unsigned long maxAge);
+
+	/**
+	 * Checks a fix with a valid location. An accepted fix becomes the
+	 * reference for the speed check of the next ones
+	 */
+	Result check(const TinyGPSFix &fix);
+
+	/**
+	 * Returns true if fix was committed more than maxAge ago. For fixes
+	 * kept after check(), such as the last one reported
+	 */
+	bool isStale(const TinyGPSFix &fix) const;
+
+ private:
+	// Meters of position jitter allowed on top of the speed limit, plus
+	// the same for each HDOP unit
+	static const unsigned int MIN_JITTER = 20;
+	static const unsigned int METERS_PER_HDOP = 5;
+
+	// After this many jumps in a row the reference is considered the wrong
+	// one and the fix is accepted. RMC and GGA report each position, so
+	// this is three fixes: three seconds at 1 Hz, 0.6 s at 5 Hz
+	static const uint8_t MAX_JUMPS = 6;
+
+	unsigned int maxHdop;
+	uint8_t minSatellites;
+	unsigned int maxSpeed;
+	unsigned long maxAge;
+
+	// Last accepted fix
+	bool hasLastFix;
+	int32_t lastLat;
+	int32_t lastLng;
+	uint16_t lastCosLat;
+	unsigned long lastTime;
+	uint8_t jumps;
+
+	// Returns true if fix is farther from the last accepted one than
+	// maxSpeed allows
+	bool isJump(const TinyGPSFix &fix, int32_t lat, int32_t lng) const;
+};
+
+#endif
+
@@ -0,0 +1,237 @@
+// 
+// 
+// 
+
+#include "FixStore.h"
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+
+// Record layout: sequence, flags, lat, lng, time, altitude, speed, course
+// and a CRC of the previous bytes. Numbers are little endian
+const uint8_t SEQUENCE_OFFSET = 0;
+const uint8_t CRC_OFFSET = FixStore::RECORD_SIZE - 1;
+
+static void writeBytes(uint8_t *record, uint32_t value, uint8_t length)
+{
+	for (uint8_t i = 0; i < length; ++i)
+	{
+		record[i] = value >> (8 * i);
+	}
+}
+
+static uint32_t readBytes(const uint8_t *record, uint8_t length)
+{
+	uint32_t value = 0;
+	for (uint8_t i = 0; i < length; ++i)
+	{
+		value |= (uint32_t)record[i] << (8 * i);
+	}
+	return value;
+}
+
+FixStore::FixStore(uint16_t address) :
+	address(address),
+	headSequence(0),
+	tailSequence(0),
+	pendingOffset(0),
+	writing(false)
+{
+}
+
+void FixStore::begin(uint16_t tail)
+{
+	// The head follows the newest valid record
+	bool found = false;
+	for (uint8_t slot = 0; slot < SLOT_COUNT; ++slot)
+	{
+		uint8_t record[RECORD_SIZE];
+		eeprom_read_block(record, (const void *)(uintptr_t)(address + slot * RECORD_SIZE), RECORD_SIZE);
+
+		uint16_t sequence;
+		FixRecord fix;
+		if (!unpack(record, sequence, fix) || (sequence % SLOT_COUNT) != slot)
+		{
+			continue;
+		}
+		if (!found || (int16_t)(sequence + 1 - headSequence) > 0)
+		{
+			found = true;
+			headSequence = sequence + 1;
+		}
+	}
+
+	if (!found)
+	{
+		headSequence = tail;
+	}
+
+	// The tail was saved some time ago, so it may be behind the oldest fix
+	// still stored or, if the records after it were lost, past the head
+	uint16_t queued = headSequence - tail;
+	if ((int16_t)queued < 0)
+	{
+		tailSequence = headSequence;
+	}
+	else if (queued > SLOT_COUNT)
+	{
+		tailSequence = headSequence - SLOT_COUNT;
+	}
+	else
+	{
+		tailSequence = tail;
+	}
+}
+
+bool FixStore::append(const FixRecord &fix)
+{
+	if (writing)
+	{
+		return false;
+	}
+
+	pack(headSequence, fix, pending);
+	pendingOffset = 0;
+	writing = true;
+
+	++headSequence;
+	if (count() > SLOT_COUNT)
+	{
+		++tailSequence;
+	}
+	return true;
+}
+
+uint8_t FixStore::peekBatch(FixRecord *fixes, uint8_t max, uint16_t &firstSequence)
+{
+	uint8_t copied = 0;
+	for (uint16_t sequence = tailSequence; sequence != headSequence && copied < max; ++sequence)
+	{
+		if (!readRecord(sequence, fixes[copied]))
+		{
+			// The batch holds consecutive sequences, a lost fix ends it and
+			// is dropped once it is the oldest one
+			if (copied > 0)
+			{
+				break;
+			}
+			++tailSequence;
+			continue;
+		}
+		if (copied == 0)
+		{
+			firstSequence = sequence;
+		}
+		++copied;
+	}
+	return copied;
+}
+
+void FixStore::commit(uint8_t count)
+{
+	uint8_t queued = this->count();
+	tailSequence += count < queued ? count : queued;
+}
+
+void FixStore::loop()
+{
+	if (!writing || !eeprom_is_ready())
+	{
+		return;
+	}
+
+	// The sequence goes last, so a record cut by a reset is not taken for
+	// the new one
+	uint8_t offset = (pendingOffset + SEQUENCE_OFFSET + 2) % RECORD_SIZE;
+	uint8_t *target = (uint8_t *)(uintptr_t)(slotAddress(readBytes(pending + SEQUENCE_OFFSET, 2)) + offset);
+	if (eeprom_read_byte(target) != pending[offset])
+	{
+		eeprom_write_byte(target, pending[offset]);
+	}
+
+	if (++pendingOffset == RECORD_SIZE)
+	{
+		writing = false;
+	}
+}
+
+uint8_t FixStore::count()
+{
+	return headSequence - tailSequence;
+}
+
+uint16_t FixStore::head()
+{
+	return headSequence;
+}
+
+uint16_t FixStore::tail()
+{
+	return tailSequence;
+}
+
+uint16_t FixStore::slotAddress(uint16_t sequence)
+{
+	return address + (sequence % SLOT_COUNT) * RECORD_SIZE;
+}
+
+bool FixStore::readRecord(uint16_t sequence, FixRecord &fix)
+{
+	uint8_t record[RECORD_SIZE];
+	if (writing && readBytes(pending + SEQUENCE_OFFSET, 2) == sequence)
+	{
+		memcpy(record, pending, RECORD_SIZE);
+	}
+	else
+	{
+		eeprom_read_block(record, (const void *)(uintptr_t)slotAddress(sequence), RECORD_SIZE);
+	}
+
+	uint16_t stored;
+	return unpack(record, stored, fix) && stored == sequence;
+}
+
+void FixStore::pack(uint16_t sequence, const FixRecord &fix, uint8_t *record)
+{
+	int32_t altitude = fix.altitude;
+	if (altitude > INT16_MAX) altitude = INT16_MAX;
+	if (altitude < INT16_MIN) altitude = INT16_MIN;
+
+	writeBytes(record + SEQUENCE_OFFSET, sequence, 2);
+	record[2] = fix.flags;
+	writeBytes(record + 3, fix.lat, 4);
+	writeBytes(record + 7, fix.lng, 4);
+	writeBytes(record + 11, fix.time, 4);
+	writeBytes(record + 15, altitude, 2);
+	record[17] = fix.speed;
+	record[18] = fix.course;
+	record[CRC_OFFSET] = crc(record);
+}
+
+bool FixStore::unpack(const uint8_t *record, uint16_t &sequence, FixRecord &fix)
+{
+	if (record[CRC_OFFSET] != crc(record))
+	{
+		return false;
+	}
+
+	sequence = readBytes(record + SEQUENCE_OFFSET, 2);
+	fix.flags = record[2];
+	fix.lat = readBytes(record + 3, 4);
+	fix.lng = readBytes(record + 7, 4);
+	fix.time = readBytes(record + 11, 4);
+	fix.altitude = (int16_t)readBytes(record + 15, 2);
+	fix.speed = record[17];
+	fix.course = record[18];
+	return true;
+}
+
+uint8_t FixStore::crc(const uint8_t *record)
+{
+	// Not 0, so an erased or cleared EEPROM does not pass
+	uint8_t result = 0x5A;
+	for (uint8_t i = 0; i < CRC_OFFSET; ++i)
+	{
+		result = _crc8_ccitt_update(result, record[i]);
+	}
+	return result;
+}
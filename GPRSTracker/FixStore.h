@@ -0,0 +1,103 @@
+// FixStore.h
+
+#ifndef _FIXSTORE_h
+#define _FIXSTORE_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+	#include "Arduino.h"
+#else
+	#include "WProgram.h"
+#endif
+
+#include "FixCodec.h"
+
+/**
+ * Queue of fixes waiting to be uploaded, kept in EEPROM so they survive a
+ * reset. Each fix gets the next sequence number and goes to slot
+ * sequence % SLOT_COUNT, so the log goes round the whole area and wears
+ * it evenly. The server uses the sequence numbers to drop fixes it got
+ * twice.
+ *
+ * Writes do not block: append() keeps the record in RAM and loop() writes
+ * one byte each time the EEPROM is ready. When the queue is full the
+ * oldest fix is overwritten.
+ */
+class FixStore
+{
+public:
+	// A power of two, so the slots follow each other when the sequence
+	// numbers wrap around
+	static const uint8_t SLOT_COUNT = 32;
+	static const uint8_t RECORD_SIZE = 20;
+
+	/**
+	 * Uses SLOT_COUNT * RECORD_SIZE bytes of EEPROM from address on
+	 */
+	FixStore(uint16_t address);
+
+	/**
+	 * Finds the last stored fix. tail is the sequence of the oldest fix not
+	 * acknowledged, as returned by tail() before the reset
+	 */
+	void begin(uint16_t tail);
+
+	/**
+	 * Queues fix. Returns false if the previous fix is still being written,
+	 * it takes a few ms for each byte
+	 */
+	bool append(const FixRecord &fix);
+
+	/**
+	 * Copies up to max of the oldest fixes into fixes and the sequence of the
+	 * first one into firstSequence. The fixes have consecutive sequences.
+	 * Returns the number of fixes copied, fixes lost to a reset during their
+	 * write are skipped
+	 */
+	uint8_t peekBatch(FixRecord *fixes, uint8_t max, uint16_t &firstSequence);
+
+	/**
+	 * Drops the count oldest fixes, once the server acknowledged them
+	 */
+	void commit(uint8_t count);
+
+	/**
+	 * Writes the next byte of an appended fix if the EEPROM is ready.
+	 * Should be called in each loop() iteration
+	 */
+	void loop();
+
+	/**
+	 * Returns the number of queued fixes
+	 */
+	uint8_t count();
+
+	/**
+	 * Returns the sequence the next fix will get
+	 */
+	uint16_t head();
+
+	/**
+	 * Returns the sequence of the oldest queued fix
+	 */
+	uint16_t tail();
+
+private:
+	uint16_t address;
+	uint16_t headSequence;
+	uint16_t tailSequence;
+
+	// Record being written and the next byte to write
+	uint8_t pending[RECORD_SIZE];
+	uint8_t pendingOffset;
+	bool writing;
+
+	uint16_t slotAddress(uint16_t sequence);
+	bool readRecord(uint16_t sequence, FixRecord &fix);
+
+	static void pack(uint16_t sequence, const FixRecord &fix, uint8_t *record);
+	static bool unpack(const uint8_t *record, uint16_t &sequence, FixRecord &fix);
+	static uint8_t crc(const uint8_t *record);
+};
+
+#endif
+
@@ -4,9 +4,13 @@
 
 #include "GPRS.h"
 #include <avr/pgmspace.h>
+#include <util/crc16.h>
 
 // GPRS constants
-const PROGMEM char HTTP_USER_AGENT[] = { "Igui's GPRS_CLIENT 0.0.1" };
+// Constant parts of the GET request, around the path and the host
+const PROGMEM char HTTP_REQUEST_START[] = "GET ";
+const PROGMEM char HTTP_REQUEST_HOST[] = " HTTP/1.1\r\nHost: ";
+const PROGMEM char HTTP_REQUEST_END[] = "\r\nUser-Agent: Igui's GPRS_CLIENT 0.0.1\r\n\r\n";
 const char *DNS_PORT = "53";
 const int IP_DATA_LENGTH = 4;
 const int DNS_ANSWER_LENGTH = 12 + IP_DATA_LENGTH;
@@ -23,12 +27,53 @@ const PROGMEM char DNS_REQUEST_SUFFIX_BYTES[] = { 0x00, 0x00,
 const unsigned long LONG_TIMEOUT = 30 * 1000;
 const unsigned long SHORT_TIMEOUT = 20 * 1000;
 
-GPRS::GPRS(SoftwareSerial &cellSerial, const char *apn, const char *apn_user, const char *apn_password, const char *dns) :
+// The module is asked if it is ready each PROBE_INTERVAL, the answer is
+// expected within PROBE_TIMEOUT
+const unsigned long PROBE_INTERVAL = 2000;
+const unsigned long PROBE_TIMEOUT = 500;
+
+// Baud rate of the module after a power up
+const long DEFAULT_BAUD_RATE = 9600;
+// Time given to the module to switch its baud rate, and the attempts to
+// talk to it at the new one
+const unsigned long BAUD_RATE_SWITCH_DELAY = 100;
+const uint8_t BAUD_RATE_VERIFY_ATTEMPTS = 3;
+
+// After a restart the module is probed from RESTART_PROBE_DELAY on, and
+// given up if it is not ready within RESTART_TIMEOUT
+const unsigned long RESTART_PROBE_DELAY = 5000;
+const unsigned long RESTART_TIMEOUT = 60 * 1000UL;
+
+// Resolved addresses are not kept longer than a day
+const unsigned long MAX_ADDRESS_TTL = 24 * 60 * 60UL;
+
+// The secondary DNS is asked if the first does not answer within
+// DNS_DEADLINE, and the next address is tried if a connection is not up
+// within CONNECT_TIMEOUT
+const unsigned long DNS_DEADLINE = 5000;
+const unsigned long CONNECT_TIMEOUT = 15 * 1000UL;
+
+// Each datagram is sent up to DATAGRAM_ATTEMPTS times, waiting
+// REPLY_TIMEOUT for the reply after each
+const uint8_t DATAGRAM_ATTEMPTS = 3;
+const unsigned long REPLY_TIMEOUT = 4000;
+const char *HTTP_PORT = "80";
+
+GPRS::GPRS(SoftwareSerial &cellSerial, const char *apn, const char *apn_user, const char *apn_password, const char *dns, const char *secondaryDNS) :
 	cellSerial(cellSerial),
 	apn(apn),
 	apn_user(apn_user),
 	apn_password(apn_password),
 	dns(dns),
+	secondaryDNS(secondaryDNS),
+	currentDNS(dns),
+	host(NULL),
+	path(NULL),
+	port(HTTP_PORT),
+	datagram(NULL),
+	datagramMode(false),
+	datagramSocketOpen(false),
+	datagramAttempts(0),
 	state(WAIT_FOR_AT_MODULE),
 	lastError(NO_ERROR),
 	connectionStatus(0),
@@ -36,9 +81,27 @@ GPRS::GPRS(SoftwareSerial &cellSerial, const char *apn, const char *apn_user, co
 	currentPartRequestedBytes(0),
 	currentPartReadBytes(0),
 	readingHighHexChar(true),
-	pdpWasSetUp(false)
+	pdpWasSetUp(false),
+	probePending(false),
+	probeCount(0),
+	keptConfigurationChecksum(0),
+	keptContextFound(false),
+	readyState(QUERY_GPRS),
+	baudRate(DEFAULT_BAUD_RATE),
+	currentBaudRate(DEFAULT_BAUD_RATE),
+	baudRateFailed(false),
+	verifyAttempts(0),
+	addressCount(0),
+	currentAddress(0),
+	hasAddress(false),
+	addressTime(0),
+	addressTTL(0),
+	dnsAnswersLeft(0),
+	moduleSilent(false),
+	chainCommands(true)
 {
 	currentHexByte[0] = '\0';
+	probeTimer.setTimeout(PROBE_INTERVAL);
 }
 
 bool GPRS::readyForCommands()
@@ -46,6 +109,77 @@ bool GPRS::readyForCommands()
 	return pdpWasSetUp && state == DONE;
 }
 
+bool GPRS::isExpectingResponse()
+{
+	if (state == WAIT_FOR_AT_MODULE)
+	{
+		return probePending;
+	}
+	if (state == SWITCH_BAUD_RATE)
+	{
+		return false;
+	}
+	return state != DONE && state != DEAD && state != ASLEEP;
+}
+
+void GPRS::setBaudRate(long baudRate, long lastBaudRate)
+{
+	this->baudRate = baudRate;
+	switchBaudRate(lastBaudRate);
+}
+
+long GPRS::getBaudRate()
+{
+	return currentBaudRate;
+}
+
+uint16_t GPRS::configurationChecksum()
+{
+	const char *settings[] = { apn, apn_user, apn_password };
+	uint16_t checksum = 0xFFFF;
+	for (int i = 0; i < 3; ++i)
+	{
+		for (const char *c = settings[i]; c && *c; ++c)
+		{
+			checksum = _crc_ccitt_update(checksum, *c);
+		}
+		checksum = _crc_ccitt_update(checksum, '\0');
+	}
+	return checksum;
+}
+
+void GPRS::assumeConfigured(uint16_t checksum)
+{
+	keptConfigurationChecksum = checksum;
+}
+
+bool GPRS::getAddress(unsigned char ip[4], unsigned long &ttl)
+{
+	if (!hasValidAddress())
+	{
+		return false;
+	}
+
+	memcpy(ip, addresses[currentAddress], sizeof(addresses[0]));
+	ttl = addressTTL - (millis() - addressTime) / 1000;
+	return true;
+}
+
+void GPRS::setAddress(const unsigned char ip[4], unsigned long ttl)
+{
+	memcpy(addresses[0], ip, sizeof(addresses[0]));
+	addressCount = 1;
+	currentAddress = 0;
+	hasAddress = true;
+	addressTime = millis();
+	addressTTL = ttl < MAX_ADDRESS_TTL ? ttl : MAX_ADDRESS_TTL;
+}
+
+bool GPRS::hasValidAddress()
+{
+	return hasAddress && (millis() - addressTime) / 1000 < addressTTL;
+}
+
 GPRS::Error GPRS::beginRequest(const char *host, const char *path)
 {
 	if (!readyForCommands())
@@ -56,6 +190,11 @@ GPRS::Error GPRS::beginRequest(const char *host, const char *path)
 	kill();
 	this->host = host;
 	this->path = path;
+	port = HTTP_PORT;
+	datagramMode = false;
+	// Socket 1 is set up for TCP now
+	datagramSocketOpen = false;
+	currentDNS = dns;
 	checkParameters();
 	if (lastError != NO_ERROR)
 	{
@@ -75,6 +214,48 @@ GPRS::Error GPRS::beginRequest(const char *host, const char *path)
 	return lastError;
 }
 
+GPRS::Error GPRS::sendDatagram(const char *host, const char *port, const char *datagram)
+{
+	if (!readyForCommands())
+	{
+		return PDP_NOT_PREPARED;
+	}
+
+	bool socketOpen = datagramSocketOpen && hasValidAddress() &&
+		strcmp(this->host, host) == 0 && strcmp(this->port, port) == 0;
+
+	kill();
+	this->host = host;
+	this->port = port;
+	this->datagram = datagram;
+	datagramMode = true;
+	datagramAttempts = 0;
+	currentDNS = dns;
+	checkParameters();
+	if (lastError != NO_ERROR)
+	{
+		return lastError;
+	}
+
+	cellSerial.listen();
+	if (socketOpen)
+	{
+		sendDatagramLength();
+		return lastError;
+	}
+
+	datagramSocketOpen = false;
+	cellSerial.print(F("AT+CGACT=0\r"));
+	Serial.print(F("AT+CGACT=0\r"));
+	success(BEGIN_REQUEST_DEACTIVATE_PDP, LONG_TIMEOUT);
+	return lastError;
+}
+
+const char *GPRS::getReply()
+{
+	return currentPart;
+}
+
 GPRS::Error GPRS::sendSMS(const char *number, const char *message)
 {
 	if (!readyForCommands())
@@ -107,11 +288,91 @@ GPRS::Error GPRS::receiveUnreadMessages(MessageCallback callback, void * data)
 	return GPRS::NO_ERROR;
 }
 
+GPRS::Error GPRS::sleep()
+{
+	if (!readyForCommands())
+	{
+		return PDP_NOT_PREPARED;
+	}
+
+	kill();
+	pdpWasSetUp = false;
+	datagramSocketOpen = false;
+	cellSerial.listen();
+	cellSerial.print(F("AT+CFUN=0\r"));
+	Serial.print(F("AT+CFUN=0\r"));
+	success(SLEEP_WAIT_FOR_OK, SHORT_TIMEOUT);
+	return GPRS::NO_ERROR;
+}
+
+GPRS::Error GPRS::wakeUp()
+{
+	if (readyForCommands())
+	{
+		return GPRS::NO_ERROR;
+	}
+
+	// Also after a failed sleep(), AT+CFUN=1 is harmless with the radio on
+	kill();
+	cellSerial.listen();
+	cellSerial.print(F("AT+CFUN=1\r"));
+	Serial.print(F("AT+CFUN=1\r"));
+	success(WAKE_UP_WAIT_FOR_OK, LONG_TIMEOUT);
+	return GPRS::NO_ERROR;
+}
+
+bool GPRS::isAsleep()
+{
+	return state == SLEEP_WAIT_FOR_OK || state == ASLEEP;
+}
+
+void GPRS::forgetAddress()
+{
+	hasAddress = false;
+}
+
 GPRS::Error GPRS::getLastError()
 {
 	return lastError;
 }
 
+void GPRS::resetPDPContext()
+{
+	kill();
+	pdpWasSetUp = false;
+	datagramSocketOpen = false;
+	cellSerial.listen();
+	setUpPDPContext(true);
+}
+
+void GPRS::restart()
+{
+	kill();
+	cellSerial.listen();
+	cellSerial.print(F("AT+CFUN=1,1\r"));
+	Serial.print(F("AT+CFUN=1,1\r"));
+	waitForRestart();
+}
+
+void GPRS::powerCycled()
+{
+	kill();
+	cellSerial.listen();
+	waitForRestart();
+}
+
+void GPRS::waitForRestart()
+{
+	pdpWasSetUp = false;
+	datagramSocketOpen = false;
+	probePending = false;
+	// The module lost its PDP context, so an answer to the first probe
+	// must not be taken as one that kept it
+	probeCount = 1;
+	probeTimer.setTimeout(RESTART_PROBE_DELAY);
+	success(WAIT_FOR_AT_MODULE, RESTART_TIMEOUT);
+}
+
 String GPRS::processIncomingASCII(char incoming_char)
 {
 	currentMessage += incoming_char;
@@ -180,7 +441,7 @@ void GPRS::checkParameters()
 	{
 		error(APN_NOT_CONFIGURED);
 	}
-	else if (!host || !path)
+	else if (!host || (datagramMode ? !datagram : !path))
 	{
 		error(REQUEST_NOT_CONFIGURED);
 	}
@@ -203,15 +464,331 @@ void GPRS::simpleStep(
 	if (lastMessage == expectedCellMessage)
 	{
 		success(nextState, timeout);
+		sendCommand(nextCommand1, nextCommand2, nextCommand3, nextCommand4, nextCommand5);
+	}
+}
+
+void GPRS::sendCommand(
+	const StringHelper &part1,
+	const StringHelper &part2,
+	const StringHelper &part3,
+	const StringHelper &part4,
+	const StringHelper &part5)
+{
+	part1.printAndSerial(cellSerial);
+	part2.printAndSerial(cellSerial);
+	part3.printAndSerial(cellSerial);
+	part4.printAndSerial(cellSerial);
+	part5.printAndSerial(cellSerial);
+}
+
+bool GPRS::isErrorMessage(const String &message)
+{
+	return message == F("ERROR") || message.startsWith(F("+CME ERROR"));
+}
+
+void GPRS::waitForModule(char incomingChar)
+{
+	auto lastMessage = processIncomingASCII(incomingChar);
+
+	if (probePending)
+	{
+		// The probe is the same query as QUERY_GPRS, so its OK means the
+		// module is ready. +SIND: 4 is ignored meanwhile, otherwise the probe
+		// answer would be taken as the answer of the next command
+		if (lastMessage == F("OK"))
+		{
+			probePending = false;
+			probeTimer.removeTimeout();
+
+			// The module may have been up before the reset. It may also have
+			// booted along and be ready by the first probe, so the context
+			// is checked
+			if (probeCount == 1 && keptConfigurationChecksum == configurationChecksum())
+			{
+				verifyPDPContext();
+			}
+			else
+			{
+				moduleReady(SETUP_PDP_CONTEXT);
+			}
+		}
+		else if (isErrorMessage(lastMessage))
+		{
+			probePending = false;
+			probeTimer.setTimeout(PROBE_INTERVAL);
+		}
+	}
+	else if (lastMessage == F("+SIND: 4"))
+	{
+		probeTimer.removeTimeout();
+		moduleReady(QUERY_GPRS);
+	}
+}
+
+void GPRS::verifyPDPContext()
+{
+	keptContextFound = false;
+	success(VERIFY_PDP_CONTEXT, SHORT_TIMEOUT);
+	sendCommand(F("AT+CGDCONT?\r"));
+}
+
+// A module that kept the context answers +CGDCONT: 1,"IP","<apn>",...
+// A blank one lists no context or an empty APN
+void GPRS::verifyPDPContextStep(char incomingChar)
+{
+	auto lastMessage = processIncomingASCII(incomingChar);
+	const char prefix[] = "+CGDCONT: 1,\"IP\",\"";
+
+	if (lastMessage.startsWith(prefix))
+	{
+		const char *contextAPN = lastMessage.c_str() + sizeof(prefix) - 1;
+		size_t apnLength = strlen(apn);
+		keptContextFound = strncmp(contextAPN, apn, apnLength) == 0 && contextAPN[apnLength] == '"';
+	}
+	else if (lastMessage == F("OK"))
+	{
+		moduleReady(keptContextFound ? DONE : SETUP_PDP_CONTEXT);
+	}
+	else if (isErrorMessage(lastMessage))
+	{
+		moduleReady(SETUP_PDP_CONTEXT);
+	}
+}
+
+void GPRS::moduleReady(State nextState)
+{
+	readyState = nextState;
+	if (baudRateFailed || currentBaudRate == baudRate)
+	{
+		continueSetUp();
+		return;
+	}
+
+	// The answer still comes at the current rate
+	cellSerial.print(F("AT+IPR="));
+	Serial.print(F("AT+IPR="));
+	cellSerial.print(baudRate);
+	Serial.print(baudRate);
+	cellSerial.print(F("\r"));
+	Serial.print(F("\r"));
+	success(SET_BAUD_RATE, SHORT_TIMEOUT);
+}
 
-		nextCommand1.printAndSerial(cellSerial);
-		nextCommand2.printAndSerial(cellSerial);
-		nextCommand3.printAndSerial(cellSerial);
-		nextCommand4.printAndSerial(cellSerial);
-		nextCommand5.printAndSerial(cellSerial);
+void GPRS::continueSetUp()
+{
+	switch (readyState)
+	{
+	case(DONE):
+		Serial.println(F("<<PDP context kept>>"));
+		success(DONE, 0);
+		pdpWasSetUp = true;
+		break;
+	case(SETUP_PDP_CONTEXT):
+		setUpPDPContext(false);
+		break;
+	default:
+		setUpPDPContext(true);
+		break;
+	}
+}
+
+void GPRS::setUpPDPContext(bool queryAttach)
+{
+	if (!chainCommands)
+	{
+		if (queryAttach)
+		{
+			success(QUERY_GPRS, LONG_TIMEOUT);
+			sendCommand(F("AT+CGATT?\r"));
+		}
+		else
+		{
+			success(SETUP_PDP_CONTEXT, SHORT_TIMEOUT);
+			sendCommand(F("AT+CGDCONT=1,\"IP\",\""), apn, F("\"\r"));
+		}
+		return;
+	}
+
+	// Only the final result comes back, the OK of the whole line
+	success(SETUP_PDP_CONTEXT_CHAIN, LONG_TIMEOUT);
+	sendCommand(
+		queryAttach ? F("AT+CGATT?;+") : F("AT+"),
+		F("CGDCONT=1,\"IP\",\""), apn,
+		F("\";+CGPCO=0,\""), apn_user);
+	sendCommand(F("\",\""), apn_password, F("\", 1\r"));
+}
+
+void GPRS::setUpPDPContextChainStep(char incomingChar)
+{
+	auto lastMessage = processIncomingASCII(incomingChar);
+
+	if (lastMessage == F("OK"))
+	{
+		success(DONE, 0);
+		pdpWasSetUp = true;
+	}
+	else if (isErrorMessage(lastMessage))
+	{
+		refuseChain();
+		setUpPDPContext(true);
+	}
+}
+
+void GPRS::startDNSConnection()
+{
+	if (!chainCommands)
+	{
+		success(START_DNS_CONNECTION, LONG_TIMEOUT);
+		sendCommand(F("AT+SDATACONF=2,\"UDP\",\""), currentDNS, F("\","), DNS_PORT, F("\r"));
+		return;
+	}
+
+	// The final OK follows the +SOCKSTATUS of the last command
+	success(START_DNS_CONNECTION_CHAIN, LONG_TIMEOUT);
+	sendCommand(F("AT+SDATACONF=2,\"UDP\",\""), currentDNS, F("\","), DNS_PORT);
+	sendCommand(F(";+SDATASTART=2,1;+SDATASTATUS=2\r"));
+}
+
+void GPRS::startHostConnection()
+{
+	success(chainCommands ? START_TCP_CONNECTION_CHAIN : START_TCP_CONNECTION, SHORT_TIMEOUT);
+	fallbackTimer.setTimeout(CONNECT_TIMEOUT);
+
+	if (datagramMode)
+	{
+		sendCommand(F("AT+SDATACONF=1,\"UDP\",\""));
+	}
+	else
+	{
+		sendCommand(F("AT+SDATACONF=1,\"TCP\",\""));
+	}
+
+	for (int i = 0; i < 4; ++i)
+	{
+		cellSerial.print(addresses[currentAddress][i], DEC);
+		Serial.print(addresses[currentAddress][i], DEC);
+		if (i < 3)
+		{
+			cellSerial.print(".");
+			Serial.print(".");
+		}
+	}
+
+	if (chainCommands)
+	{
+		sendCommand(F("\","), port, F(";+SDATASTART=1,1;+SDATASTATUS=1\r"));
+	}
+	else
+	{
+		sendCommand(F("\","), port, F("\r"));
 	}
 }
 
+void GPRS::startConnectionChainStep(char incomingChar, State nextState)
+{
+	auto lastMessage = processIncomingASCII(incomingChar);
+
+	if (isErrorMessage(lastMessage))
+	{
+		refuseChain();
+		if (nextState == QUERY_DNS_CONN_STATUS_WAIT_FOR_OK)
+		{
+			startDNSConnection();
+		}
+		else
+		{
+			startHostConnection();
+		}
+		return;
+	}
+
+	readConnectionStatus(lastMessage, nextState);
+}
+
+void GPRS::refuseChain()
+{
+	// Either the module does not take concatenated commands or one of
+	// them failed. The commands are sent one by one from now on, so a
+	// failure is told apart from the others
+	Serial.println(F("<<Chained commands refused>>"));
+	chainCommands = false;
+}
+
+void GPRS::setBaudRateStep(char incomingChar)
+{
+	auto lastMessage = processIncomingASCII(incomingChar);
+
+	if (lastMessage == F("OK"))
+	{
+		// behaviourNoInput() switches once the module had the time to
+		probeTimer.setTimeout(BAUD_RATE_SWITCH_DELAY);
+		success(SWITCH_BAUD_RATE, 0);
+	}
+	else if (isErrorMessage(lastMessage))
+	{
+		// The module does not support the rate, it stays at the current one
+		baudRateFailed = true;
+		continueSetUp();
+	}
+}
+
+void GPRS::verifyBaudRate()
+{
+	cellSerial.print(F("AT\r"));
+	Serial.print(F("AT\r"));
+	probeTimer.setTimeout(PROBE_TIMEOUT);
+	success(VERIFY_BAUD_RATE, 0);
+}
+
+void GPRS::verifyBaudRateStep(char incomingChar)
+{
+	auto lastMessage = processIncomingASCII(incomingChar);
+
+	if (lastMessage == F("OK"))
+	{
+		probeTimer.removeTimeout();
+		Serial.print(F("<<Modem at "));
+		Serial.print(currentBaudRate);
+		Serial.println(F(" baud>>"));
+		continueSetUp();
+	}
+}
+
+void GPRS::switchBaudRate(long rate)
+{
+	currentBaudRate = rate;
+	cellSerial.begin(rate);
+	currentMessage = "";
+}
+
+void GPRS::probeModule()
+{
+	if (probePending)
+	{
+		// No answer, the module is still booting or it talks at the other
+		// rate
+		probePending = false;
+		if (baudRate != DEFAULT_BAUD_RATE)
+		{
+			switchBaudRate(currentBaudRate == baudRate ? DEFAULT_BAUD_RATE : baudRate);
+		}
+		probeTimer.setTimeout(PROBE_INTERVAL);
+		return;
+	}
+
+	cellSerial.listen();
+	cellSerial.print(F("AT+CGATT?\r"));
+	Serial.print(F("AT+CGATT?\r"));
+	probePending = true;
+	moduleSilent = true;
+	if (probeCount < 255)
+	{
+		++probeCount;
+	}
+	probeTimer.setTimeout(PROBE_TIMEOUT);
+}
+
 void GPRS::waitForSetUp(char incomingChar)
 {
 	auto lastMessage = processIncomingASCII(incomingChar);
@@ -225,8 +802,11 @@ void GPRS::waitForSetUp(char incomingChar)
 
 void GPRS::queryConnStatusWaitForConnection(char incomingChar, GPRS::State nextState)
 {
-	auto lastMessage = processIncomingASCII(incomingChar);
+	readConnectionStatus(processIncomingASCII(incomingChar), nextState);
+}
 
+void GPRS::readConnectionStatus(const String &lastMessage, GPRS::State nextState)
+{
 	if (!lastMessage.startsWith("+SOCKSTATUS:"))
 	{
 		return;
@@ -244,11 +824,27 @@ void GPRS::queryConnStatusWaitForConnection(char incomingChar, GPRS::State nextS
 	success(nextState, SHORT_TIMEOUT);
 }
 
-int GPRS::getRawRequestDataLength()
+size_t GPRS::writeRequest(Print *out)
 {
-	return 4 + strlen(path) + 11 +
-		6 + strlen(host) + 2 +
-		12 + sizeof(HTTP_USER_AGENT) + 4;
+	return writeFragment(out, HTTP_REQUEST_START, sizeof(HTTP_REQUEST_START) - 1) +
+		writeField(out, path) +
+		writeFragment(out, HTTP_REQUEST_HOST, sizeof(HTTP_REQUEST_HOST) - 1) +
+		writeField(out, host) +
+		writeFragment(out, HTTP_REQUEST_END, sizeof(HTTP_REQUEST_END) - 1);
+}
+
+size_t GPRS::writeFragment(Print *out, const char *fragment, size_t length)
+{
+	if (out)
+	{
+		out->print(reinterpret_cast<const __FlashStringHelper *>(fragment));
+	}
+	return length;
+}
+
+size_t GPRS::writeField(Print *out, const char *field)
+{
+	return out ? out->print(field) : strlen(field);
 }
 
 void GPRS::readDNSSDataPrefix(char incomingChar)
@@ -295,6 +891,12 @@ void GPRS::readDNSHeaderStatus(char incomingChar)
 			return;
 		}
 
+		dnsAnswersLeft = ((unsigned char)currentPart[6] << 8) | (unsigned char)currentPart[7];
+		addressCount = 0;
+		currentAddress = 0;
+		addressTTL = MAX_ADDRESS_TTL;
+		fallbackTimer.removeTimeout();
+
 		currentPartRequestedBytes = 1 + strlen(host) + sizeof(DNS_REQUEST_SUFFIX_BYTES);
 		currentPartReadBytes = 0;
 		success(SKIP_DNS_SKIP_RESPONSE_QUERY, SHORT_TIMEOUT);
@@ -310,7 +912,7 @@ void GPRS::setUpSkipDNSAnswer()
 	success(SKIP_DNS_ANSWER, 0);
 }
 
-void GPRS::skipResponseBytes(char incomingChar, GPRS::State nextState)
+void GPRS::skipResponseBytes(char incomingChar)
 {
 	if (processIncomingHex(incomingChar, true) != NO_ERROR)
 	{
@@ -320,13 +922,11 @@ void GPRS::skipResponseBytes(char incomingChar, GPRS::State nextState)
 	if (currentPartReadBytes == currentPartRequestedBytes)
 	{
 		Serial.println();
-		currentPartRequestedBytes = DNS_ANSWER_LENGTH;
-		currentPartReadBytes = 0;
-		success(READ_ONE_DNS_ANSWER, SHORT_TIMEOUT);
+		nextDNSAnswer();
 	}
 }
 
-void GPRS::readDNSFirstAnswer(char incomingChar)
+void GPRS::readDNSAnswer(char incomingChar)
 {
 	if (processIncomingHex(incomingChar, false) != NO_ERROR)
 	{
@@ -337,6 +937,7 @@ void GPRS::readDNSFirstAnswer(char incomingChar)
 	{
 		Serial.println();
 		Serial.println(F("Read answer section"));
+		--dnsAnswersLeft;
 
 		if (currentPart[2] != 0 || currentPart[3] != 1)
 		{
@@ -367,10 +968,18 @@ void GPRS::readDNSFirstAnswer(char incomingChar)
 			return;
 		}
 
-		ip[0] = currentPart[12];
-		ip[1] = currentPart[13];
-		ip[2] = currentPart[14];
-		ip[3] = currentPart[15];
+		// The addresses are kept as long as the shortest lived one
+		unsigned long ttl = 0;
+		for (int i = 6; i < 10; ++i)
+		{
+			ttl = (ttl << 8) | (unsigned char)currentPart[i];
+		}
+		if (ttl < addressTTL)
+		{
+			addressTTL = ttl;
+		}
+		unsigned char *ip = addresses[addressCount++];
+		memcpy(ip, currentPart + 12, sizeof(addresses[0]));
 
 		Serial.print(F("Got IP: "));
 		Serial.print(ip[0], 10);
@@ -379,12 +988,67 @@ void GPRS::readDNSFirstAnswer(char incomingChar)
 		Serial.print(".");
 		Serial.print(ip[2], 10);
 		Serial.print(".");
-		Serial.println(ip[3], 10);
+		Serial.print(ip[3], 10);
+		Serial.print(F(" TTL "));
+		Serial.println(ttl, 10);
 
+		nextDNSAnswer();
+	}
+}
+
+void GPRS::nextDNSAnswer()
+{
+	currentPartReadBytes = 0;
+	if (dnsAnswersLeft > 0 && addressCount < MAX_ADDRESSES)
+	{
+		currentPartRequestedBytes = DNS_ANSWER_LENGTH;
+		success(READ_DNS_ANSWER, SHORT_TIMEOUT);
+	}
+	else if (addressCount > 0)
+	{
+		// The rest of the answer is skipped
+		hasAddress = true;
+		addressTime = millis();
 		currentPartRequestedBytes = 0;
-		currentPartReadBytes = 0;
 		success(READ_DNS_ANSWER_END, SHORT_TIMEOUT);
 	}
+	else
+	{
+		Serial.println(F("Got no A records"));
+		error(DNS_NO_ANSWER);
+		state = READ_DNS_ANSWER_END_ERROR;
+	}
+}
+
+void GPRS::askSecondaryDNS()
+{
+	Serial.println(F("<<Asking secondary DNS>>"));
+	fallbackTimer.removeTimeout();
+	currentDNS = secondaryDNS;
+
+	// Once the socket is closed it is set up again for currentDNS
+	cellSerial.print(F("AT+SDATASTART=2,0\r"));
+	Serial.print(F("AT+SDATASTART=2,0\r"));
+	success(CONFIGURE_DNS_HOST_CONNECTION, SHORT_TIMEOUT);
+}
+
+void GPRS::connectNextAddress()
+{
+	fallbackTimer.removeTimeout();
+	if (currentAddress + 1 >= addressCount)
+	{
+		currentAddress = 0;
+		error(CONNECT_FAILED);
+		return;
+	}
+
+	++currentAddress;
+	Serial.println(F("<<Trying next address>>"));
+
+	// Once the socket is closed it is set up again for the next address
+	cellSerial.print(F("AT+SDATASTART=1,0\r"));
+	Serial.print(F("AT+SDATASTART=1,0\r"));
+	success(CONFIGURE_REMOTE_HOST, SHORT_TIMEOUT);
 }
 
 void GPRS::readUntilEndLine(char incomingChar, GPRS::State nextStatus, bool hasError)
@@ -414,23 +1078,27 @@ void GPRS::configureRemoteHost(char incomingChar)
 
 	if (lastMessage == "OK")
 	{
-		success(START_TCP_CONNECTION, SHORT_TIMEOUT);
+		startHostConnection();
+	}
+}
 
-		cellSerial.print(F("AT+SDATACONF=1,\"TCP\",\""));
-		Serial.print(F("AT+SDATACONF=1,\"TCP\",\""));
+void GPRS::configureDNSHost(char incomingChar)
+{
+	auto lastMessage = processIncomingASCII(incomingChar);
 
-		for (int i = 0; i < 4; ++i)
-		{
-			cellSerial.print(ip[i], DEC);
-			Serial.print(ip[i], DEC);
-			if (i < 3)
-			{
-				cellSerial.print(".");
-				Serial.print(".");
-			}
-		}
-		cellSerial.print(F("\",80\r"));
-		Serial.print(F("\",80\r"));
+	if (lastMessage == F("OK"))
+	{
+		startDNSConnection();
+	}
+}
+
+void GPRS::wakeUpStep(char incomingChar)
+{
+	auto lastMessage = processIncomingASCII(incomingChar);
+
+	if (lastMessage == F("OK"))
+	{
+		setUpPDPContext(true);
 	}
 }
 
@@ -513,6 +1181,14 @@ void GPRS::readMessageBody(char incomingChar)
 
 void GPRS::error(Error lastError)
 {
+	// The host may have moved, the address is resolved again next time
+	if (state >= CONFIGURE_REMOTE_HOST && state <= WAIT_FOR_CONN_CLOSE)
+	{
+		hasAddress = false;
+	}
+	datagramSocketOpen = false;
+
+
 	Serial.print(F("<<<ERROR>>> "));
 	Serial.println(lastError);
 	state = DONE;
@@ -524,6 +1200,7 @@ void GPRS::success(State newState, unsigned long timeout)
 {
 	state = newState;
 	lastError = NO_ERROR;
+	moduleSilent = true;
 	if(timeout > 0)
 	{
 		timer.setTimeout(timeout);
@@ -552,7 +1229,6 @@ void GPRS::kill()
 	state = DEAD;
 	timer.removeTimeout();
 	lastError = NO_ERROR;
-	ip[0] = ip[1] = ip[2] = ip[3] = 0;
 	connectionStatus = 0;
 	responseRemainingBytes = 0;
 	currentPartRequestedBytes = 0;
@@ -560,6 +1236,7 @@ void GPRS::kill()
 	readingHighHexChar = true;
 	currentHexByte[0] = '\0';
 	timer.removeTimeout();
+	fallbackTimer.removeTimeout();
 }
 
 void GPRS::queryConnStatusWaitForOK(char incomingChar, const char *connectionId, int dataLength, State onNoConn, State onYesConn)
@@ -576,6 +1253,11 @@ void GPRS::queryConnStatusWaitForOK(char incomingChar, const char *connectionId,
 	switch (connectionStatus)
 	{
 	case(0):
+		if (onNoConn == QUERY_CONN_STATUS_WAIT_FOR_CONN_STATUS && fallbackTimer.wasExpired())
+		{
+			connectNextAddress();
+			break;
+		}
 		delay(CONNECTION_STATUS_LOOP_INTERVAL);
 		cellSerial.print(F("AT+SDATASTATUS="));
 		Serial.print(F("AT+SDATASTATUS="));
@@ -611,21 +1293,95 @@ void GPRS::sendPacketDataSendData(char incomingChar)
 		return;
 	}
 
+	if (datagramMode)
+	{
+		Serial.print(F("<<Sending datagram>>\n"));
+		cellSerial.print(datagram);
+		cellSerial.write(26); // Control+Z
+
+		++datagramAttempts;
+		datagramSocketOpen = true;
+		fallbackTimer.setTimeout(REPLY_TIMEOUT);
+		success(SEND_PACKET_DATA_WRITE, SHORT_TIMEOUT);
+		return;
+	}
+
 	Serial.print(F("<<Sending data>>\n"));
 
-	cellSerial.print(F("GET "));
-	cellSerial.print(path);
-	cellSerial.print(F(" HTTP/1.1\r\n"));
-	cellSerial.print(F("Host: "));
-	cellSerial.print(host);
-	cellSerial.print(F("\r\nUser-Agent: "));
-	cellSerial.print(HTTP_USER_AGENT);
-	cellSerial.print(F("\r\n\r\n"));
+	writeRequest(&cellSerial);
 	cellSerial.write(26); // Control+Z
 
 	success(SEND_PACKET_DATA_WRITE, SHORT_TIMEOUT);
 }
 
+void GPRS::sendDatagramLength()
+{
+	cellSerial.print(F("AT+SDATATSEND=1,"));
+	Serial.print(F("AT+SDATATSEND=1,"));
+	cellSerial.print(strlen(datagram));
+	Serial.print(strlen(datagram));
+	cellSerial.print(F("\r"));
+	Serial.print(F("\r"));
+	success(SEND_PACKET_DATA_SET_LENGTH, SHORT_TIMEOUT);
+}
+
+void GPRS::readReplySDataPrefix(char incomingChar)
+{
+	processIncomingASCII(incomingChar);
+	if (currentMessage.startsWith("+SDATA:1,") &&
+		currentMessage.length() > 10 &&
+		currentMessage.endsWith(",")
+		)
+	{
+		responseRemainingBytes = currentMessage.substring(9).toInt();
+		currentMessage = "";
+		currentPartReadBytes = 0;
+		fallbackTimer.removeTimeout();
+		if (responseRemainingBytes <= 0)
+		{
+			currentPart[0] = '\0';
+			replyRead();
+			return;
+		}
+		success(READ_REPLY, SHORT_TIMEOUT);
+	}
+}
+
+void GPRS::readReply(char incomingChar)
+{
+	// What does not fit in currentPart is read but not kept
+	if (processIncomingHex(incomingChar, currentPartReadBytes >= MAX_MESSAGE_LENGTH - 1) != NO_ERROR)
+	{
+		return;
+	}
+
+	if (responseRemainingBytes == 0)
+	{
+		currentPart[min(currentPartReadBytes, MAX_MESSAGE_LENGTH - 1)] = '\0';
+		Serial.print(F("\n<<Reply: "));
+		Serial.print(currentPart);
+		Serial.println(F(">>"));
+		replyRead();
+	}
+}
+
+void GPRS::replyRead()
+{
+	// The start of an HTTP response is kept, enough for the status line
+	if (!datagramMode && !isSuccessStatus(currentPart))
+	{
+		error(HTTP_STATUS_NOT_OK);
+		return;
+	}
+	success(DONE, 0);
+}
+
+bool GPRS::isSuccessStatus(const char *reply)
+{
+	return strncmp_P(reply, PSTR("HTTP/1."), 7) == 0 && isdigit(reply[7]) &&
+		reply[8] == ' ' && reply[9] == '2' && isdigit(reply[10]) && isdigit(reply[11]);
+}
+
 void GPRS::printCharSerial(const char c)
 {
 	Serial.print(String(int(c >> 4), HEX));
@@ -634,16 +1390,12 @@ void GPRS::printCharSerial(const char c)
 
 void GPRS::writeProgMemBuffer(const char *progMembuffer, size_t bufsize)
 {
-	char *buffer = (char *) malloc(bufsize);
-	memccpy_P(buffer, DNS_REQUEST_HEADER_BYTES, 1, bufsize);
-
-	cellSerial.write(buffer, bufsize);
-	for (unsigned int i = 0; i < bufsize; ++i)
+	for (size_t i = 0; i < bufsize; ++i)
 	{
-		printCharSerial(buffer[i]);
+		char c = pgm_read_byte(progMembuffer + i);
+		cellSerial.write(c);
+		printCharSerial(c);
 	}
-
-	free(buffer);
 }
 
 void GPRS::sendDNSRequest(char incomingChar)
@@ -692,6 +1444,11 @@ void GPRS::sendDNSRequest(char incomingChar)
 
 	Serial.print(F(" ESC\n"));
 
+	if (secondaryDNS && currentDNS != secondaryDNS)
+	{
+		fallbackTimer.setTimeout(DNS_DEADLINE);
+	}
+
 	success(SEND_DNS_PACKET_DATA_WRITE, SHORT_TIMEOUT);
 }
 
@@ -705,6 +1462,7 @@ int GPRS::getDNSRequestPacketLength()
 
 void GPRS::behaviour(char incomingChar) {
 	Serial.print(incomingChar); 
+	moduleSilent = false;
 	if (timer.wasExpired())
 	{
 		error(TIMEOUT);
@@ -714,12 +1472,16 @@ void GPRS::behaviour(char incomingChar) {
 	switch (state)
 	{
 	case(WAIT_FOR_AT_MODULE):
-		simpleStep(incomingChar,
-			F("+SIND: 4"),
-			QUERY_GPRS,
-			LONG_TIMEOUT,
-			F("AT+CGATT?\r")
-		);
+		waitForModule(incomingChar);
+		break;
+	case(VERIFY_PDP_CONTEXT):
+		verifyPDPContextStep(incomingChar);
+		break;
+	case(SET_BAUD_RATE):
+		setBaudRateStep(incomingChar);
+		break;
+	case(VERIFY_BAUD_RATE):
+		verifyBaudRateStep(incomingChar);
 		break;
 	case(QUERY_GPRS):
 		simpleStep(
@@ -741,6 +1503,9 @@ void GPRS::behaviour(char incomingChar) {
 	case(SET_PDP_CONTEXT_USER_PASS):
 		waitForSetUp(incomingChar);
 		break;
+	case(SETUP_PDP_CONTEXT_CHAIN):
+		setUpPDPContextChainStep(incomingChar);
+		break;
 	case(BEGIN_REQUEST_REACTIVATE_PDP):
 		simpleStep(
 			incomingChar,
@@ -758,13 +1523,16 @@ void GPRS::behaviour(char incomingChar) {
 			F("AT+CGACT=1,1\r"));
 		break;
 	case(CONFIGURE_DNS_HOST_CONNECTION):
-		simpleStep(
-			incomingChar,
-			F("OK"),
-			START_DNS_CONNECTION,
-			LONG_TIMEOUT,
-			F("AT+SDATACONF=2,\"UDP\",\""),  dns, F("\","), DNS_PORT, F("\r")
-		);
+		// The DNS is skipped while the address is valid
+		if (hasValidAddress())
+		{
+			configureRemoteHost(incomingChar);
+			break;
+		}
+		configureDNSHost(incomingChar);
+		break;
+	case(START_DNS_CONNECTION_CHAIN):
+		startConnectionChainStep(incomingChar, QUERY_DNS_CONN_STATUS_WAIT_FOR_OK);
 		break;
 	case(START_DNS_CONNECTION):
 		simpleStep(
@@ -813,10 +1581,10 @@ void GPRS::behaviour(char incomingChar) {
 		readDNSHeaderStatus(incomingChar);
 		break;
 	case(SKIP_DNS_SKIP_RESPONSE_QUERY):
-		skipResponseBytes(incomingChar, READ_ONE_DNS_ANSWER);
+		skipResponseBytes(incomingChar);
 		break;
-	case(READ_ONE_DNS_ANSWER):
-		readDNSFirstAnswer(incomingChar);
+	case(READ_DNS_ANSWER):
+		readDNSAnswer(incomingChar);
 		break;
 	case(READ_DNS_ANSWER_END):
 		readUntilEndLine(incomingChar, CONFIGURE_REMOTE_HOST, false);
@@ -825,12 +1593,15 @@ void GPRS::behaviour(char incomingChar) {
 		readUntilEndLine(incomingChar, DONE, true);
 		break;
 	case(SKIP_DNS_ANSWER):
-		skipResponseBytes(incomingChar, READ_ONE_DNS_ANSWER);
+		skipResponseBytes(incomingChar);
 		break;
 
 	case(CONFIGURE_REMOTE_HOST):
 		configureRemoteHost(incomingChar);
 		break;
+	case(START_TCP_CONNECTION_CHAIN):
+		startConnectionChainStep(incomingChar, QUERY_CONN_STATUS_WAIT_FOR_OK);
+		break;
 	case(START_TCP_CONNECTION):
 		simpleStep(
 			incomingChar,
@@ -859,7 +1630,7 @@ void GPRS::behaviour(char incomingChar) {
 		queryConnStatusWaitForOK(
 			incomingChar,
 			"1",
-			getRawRequestDataLength(),
+			datagramMode ? strlen(datagram) : writeRequest(NULL),
 			QUERY_CONN_STATUS_WAIT_FOR_CONN_STATUS,
 			SEND_PACKET_DATA_SET_LENGTH);
 		break;
@@ -870,19 +1641,31 @@ void GPRS::behaviour(char incomingChar) {
 		simpleStep(
 			incomingChar,
 			F("OK"),
-			SEND_PACKET_DATA_RECEIVED,
+			datagramMode ? READ_REPLY_SDATA_PREFIX : SEND_PACKET_DATA_RECEIVED,
 			SHORT_TIMEOUT
 		);
 		break;
+	case(READ_REPLY_SDATA_PREFIX):
+		readReplySDataPrefix(incomingChar);
+		break;
+	case(READ_REPLY):
+		readReply(incomingChar);
+		break;
 	case(SEND_PACKET_DATA_RECEIVED):
 		simpleStep(
 			incomingChar,
 			F("+STCPD:1"),
-			DONE,
+			READ_REPLY_SDATA_PREFIX,
 			SHORT_TIMEOUT,
 			F("AT+SDATATREAD=1\r")
 		);
 		break;
+	case(SLEEP_WAIT_FOR_OK):
+		simpleStep(incomingChar, F("OK"), ASLEEP, 0);
+		break;
+	case(WAKE_UP_WAIT_FOR_OK):
+		wakeUpStep(incomingChar);
+		break;
 	case(CONFIGURE_SMS_FORMAT_SEND):
 		simpleStep(
 			incomingChar,
@@ -921,8 +1704,54 @@ void GPRS::behaviourNoInput()
 {
 	if (timer.wasExpired())
 	{
-		error(TIMEOUT);
+		error(moduleSilent && !isWaitingForRemote() ? MODULE_NOT_RESPONDING : TIMEOUT);
+	}
+	else if (state == READ_DNS_SDATA_PREFIX && fallbackTimer.wasExpired())
+	{
+		askSecondaryDNS();
 	}
+	else if (state == READ_REPLY_SDATA_PREFIX && datagramMode && fallbackTimer.wasExpired())
+	{
+		if (datagramAttempts >= DATAGRAM_ATTEMPTS)
+		{
+			error(NO_REPLY);
+			return;
+		}
+		Serial.println(F("<<Sending datagram again>>"));
+		sendDatagramLength();
+	}
+	else if (state == WAIT_FOR_AT_MODULE && probeTimer.wasExpired())
+	{
+		probeModule();
+	}
+	else if (state == SWITCH_BAUD_RATE && probeTimer.wasExpired())
+	{
+		switchBaudRate(baudRate);
+		verifyAttempts = 0;
+		verifyBaudRate();
+	}
+	else if (state == VERIFY_BAUD_RATE && probeTimer.wasExpired())
+	{
+		if (++verifyAttempts < BAUD_RATE_VERIFY_ATTEMPTS)
+		{
+			verifyBaudRate();
+			return;
+		}
+
+		// The new rate does not work over SoftwareSerial, the probes look
+		// for the module at both rates and it is not switched again
+		Serial.println(F("<<Baud rate not verified>>"));
+		baudRateFailed = true;
+		success(WAIT_FOR_AT_MODULE, 0);
+		probeTimer.setTimeout(PROBE_INTERVAL);
+	}
+}
+
+bool GPRS::isWaitingForRemote()
+{
+	// The module took the data and waits for the answer of the other end
+	return state == READ_DNS_SDATA_PREFIX || state == SEND_PACKET_DATA_RECEIVED ||
+		state == READ_REPLY_SDATA_PREFIX;
 }
 
 GPRS::StringHelper::StringHelper(const char *s):type(CHAR_POINTER)
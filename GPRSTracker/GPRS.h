@@ -13,6 +13,8 @@
 #include <SoftwareSerial.h>
 
 const int MAX_MESSAGE_LENGTH = 32;
+// A records kept from a DNS answer
+const uint8_t MAX_ADDRESSES = 4;
 
 class GPRS {
 public:
@@ -26,7 +28,15 @@ public:
 		DNS_NO_ANSWER,
 		PDP_NOT_PREPARED,
 		SMS_UNRECOGNIZED_RESPONSE,
-		TIMEOUT
+		TIMEOUT,
+		// Timed out without a single byte from the module
+		MODULE_NOT_RESPONDING,
+		// None of the host addresses took the connection
+		CONNECT_FAILED,
+		// A datagram was sent DATAGRAM_ATTEMPTS times without a reply
+		NO_REPLY,
+		// The HTTP response was not a 2xx status
+		HTTP_STATUS_NOT_OK
 	};
 
 	typedef void(*MessageCallback)(void *data, const String &number, const String &message);
@@ -54,9 +64,17 @@ private:
 	enum State {
 		// Initialization
 		WAIT_FOR_AT_MODULE,
+		// Queries the PDP context the module may have kept
+		VERIFY_PDP_CONTEXT,
+		SET_BAUD_RATE,
+		// The module took AT+IPR, waiting before talking at the new rate
+		SWITCH_BAUD_RATE,
+		VERIFY_BAUD_RATE,
 		QUERY_GPRS,
 		SETUP_PDP_CONTEXT,
 		SET_PDP_CONTEXT_USER_PASS,
+		// The three above sent in one line
+		SETUP_PDP_CONTEXT_CHAIN,
 
 		// Begin Request Begin steps: Reactivate PDP
 		BEGIN_REQUEST_DEACTIVATE_PDP,
@@ -65,6 +83,8 @@ private:
 		// DNS Resolution 
 		CONFIGURE_DNS_HOST_CONNECTION,
 		START_DNS_CONNECTION,
+		// Configure, start and query status sent in one line
+		START_DNS_CONNECTION_CHAIN,
 		QUERY_DNS_CONN_STATUS_START,
 		QUERY_DNS_CONN_STATUS_WAIT_FOR_CONN_STATUS,
 		QUERY_DNS_CONN_STATUS_WAIT_FOR_OK,
@@ -73,7 +93,7 @@ private:
 		READ_DNS_SDATA_PREFIX,
 		READ_DNS_HEADER_STATUS,
 		SKIP_DNS_SKIP_RESPONSE_QUERY,
-		READ_ONE_DNS_ANSWER,
+		READ_DNS_ANSWER,
 		READ_DNS_ANSWER_END,
 		SKIP_DNS_ANSWER,
 		READ_DNS_ANSWER_END_ERROR,
@@ -82,12 +102,16 @@ private:
 		// Packet transmition
 		CONFIGURE_REMOTE_HOST,
 		START_TCP_CONNECTION,
+		// Configure, start and query status sent in one line
+		START_TCP_CONNECTION_CHAIN,
 		QUERY_CONN_STATUS_START,
 		QUERY_CONN_STATUS_WAIT_FOR_CONN_STATUS,
 		QUERY_CONN_STATUS_WAIT_FOR_OK,
 		SEND_PACKET_DATA_SET_LENGTH,
 		SEND_PACKET_DATA_WRITE,
 		SEND_PACKET_DATA_RECEIVED,
+		READ_REPLY_SDATA_PREFIX,
+		READ_REPLY,
 		WAIT_FOR_CONN_CLOSE,
 
 		// Send SMS
@@ -100,6 +124,11 @@ private:
 		READ_MESSAGE_HEADER,
 		READ_MESSAGE_BODY,
 
+		// Sleep
+		SLEEP_WAIT_FOR_OK,
+		ASLEEP,
+		WAKE_UP_WAIT_FOR_OK,
+
 		// Others
 		DONE,
 
@@ -115,11 +144,20 @@ private:
 	const char *apn_user;
 	const char *apn_password;
 	const char *dns;
+	const char *secondaryDNS;
+	// The one being asked
+	const char *currentDNS;
 
 	// GET Request
-	unsigned char ip[4];
 	const char *host;
 	const char *path;
+	const char *port;
+
+	// Datagram, sent over an UDP socket that is kept open between them
+	const char *datagram;
+	bool datagramMode;
+	bool datagramSocketOpen;
+	uint8_t datagramAttempts;
 
 	// SMS Message 
 	const char *smsNumber;
@@ -155,13 +193,59 @@ private:
 
 	// Used to calculate timeout
 	Timer timer;
+
+	// Used while waiting for the module, which is probed in case its
+	// +SIND: 4 was missed, and while it switches its baud rate
+	Timer probeTimer;
+	bool probePending;
+	uint8_t probeCount;
+
+	// Checksum of the PDP context the module may have kept from before,
+	// and whether AT+CGDCONT? showed it still has it
+	uint16_t keptConfigurationChecksum;
+	bool keptContextFound;
+
+	// Step that follows once the module is ready and the baud rate set
+	State readyState;
+
+	// Baud rate to switch to and the one cellSerial is at. If the module
+	// does not answer at the new rate it is not tried again
+	long baudRate;
+	long currentBaudRate;
+	bool baudRateFailed;
+	uint8_t verifyAttempts;
+
+	// Resolved host addresses, valid for addressTTL seconds since
+	// addressTime. Requests go to the current one, and fail over to the
+	// next ones if it does not take the connection
+	unsigned char addresses[MAX_ADDRESSES][4];
+	uint8_t addressCount;
+	uint8_t currentAddress;
+	bool hasAddress;
+	unsigned long addressTime;
+	unsigned long addressTTL;
+
+	// A records still to be read from the DNS answer
+	uint16_t dnsAnswersLeft;
+
+	// Deadline to ask the secondary DNS, or to try the next address
+	Timer fallbackTimer;
+
+	// Cleared by any byte from the module, tells a hung module apart
+	// from a slow network when a step times out
+	bool moduleSilent;
+
+	// Linear command sequences are sent concatenated with ';' in a single
+	// line until the module refuses one
+	bool chainCommands;
 public:
 	/**
 	 * Inits the GPRS with an APN settings, and a DNS as a string like "8.8.8.8"
+	 * The secondaryDNS is asked if dns does not answer in a few seconds.
 	 * The invoker MUST call to loop or loopNoInput when a character comes from
 	 * the serial port
 	 */
-	GPRS(SoftwareSerial &cellSerial, const char *apn, const char *apn_user, const char *apn_password, const char *dns);
+	GPRS(SoftwareSerial &cellSerial, const char *apn, const char *apn_user, const char *apn_password, const char *dns, const char *secondaryDNS = NULL);
 	
 	/**
 	 * Returns true if the Module is ready for beginRequest() commands
@@ -169,18 +253,100 @@ public:
 	bool readyForCommands();
 
 	/**
-	*  Returns any error ocurred during the call to readyForCommands().
-	*  Errors are generally non recoverable so the GPRS module has to be
-	*  Hard reset after this. :(
-	*/
+	 * Returns true while an answer from the module is expected, so cellSerial
+	 * must be listening. Otherwise another port can listen meanwhile
+	 */
+	bool isExpectingResponse();
+
+	/**
+	 * Makes the module switch to baudRate with AT+IPR once it is ready.
+	 * lastBaudRate is the rate it was left at, as getBaudRate() returned
+	 * before a reset. Opens cellSerial, must be called before loop()
+	 */
+	void setBaudRate(long baudRate, long lastBaudRate);
+
+	/**
+	 * Returns the baud rate the module talks at
+	 */
+	long getBaudRate();
+
+	/**
+	 * Returns a checksum of the APN settings, to tell if a PDP context was
+	 * set up with the same ones
+	 */
+	uint16_t configurationChecksum();
+
+	/**
+	 * Tells that the module was configured with the settings of checksum
+	 * before a reset. If checksum matches configurationChecksum() and the
+	 * module answers the first probe, the PDP context is queried and only
+	 * set up again if it lost the APN
+	 */
+	void assumeConfigured(uint16_t checksum);
+
+	/**
+	 * Copies the host address that took the last connection into ip and
+	 * the seconds it remains valid into ttl. Returns false if there is no
+	 * valid address
+	 */
+	bool getAddress(unsigned char ip[4], unsigned long &ttl);
+
+	/**
+	 * Sets a host address resolved before, valid for ttl seconds. The
+	 * requests use it instead of asking the DNS until it expires
+	 */
+	void setAddress(const unsigned char ip[4], unsigned long ttl);
+
+	/**
+	 * Forgets the resolved host address, so the next request asks the DNS
+	 */
+	void forgetAddress();
+
+	/**
+	 *  Returns the error that ended the last operation, NO_ERROR while it
+	 *  goes on or if it succeeded. Recovery tells what to do about each
+	 *  one, from a plain retry to a restart of the module
+	 */
 	Error getLastError();
 
+	/**
+	 * Sets the PDP context up again, cancelling any previous command
+	 */
+	void resetPDPContext();
+
+	/**
+	 * Resets the module with AT+CFUN=1,1 and waits for it to start up
+	 * again. readyForCommands() is true once the PDP context is set up
+	 */
+	void restart();
+
+	/**
+	 * Waits for the module to start up after its supply was cut
+	 */
+	void powerCycled();
+
 	/**
 	 * Initiates a GET Request. Host must be a name "example.com" and path
-	 * a valid URL encoded path "/some?a=1&b=2"
+	 * a valid URL encoded path "/some?a=1&b=2". It fails with
+	 * HTTP_STATUS_NOT_OK unless the response has a 2xx status
 	 */
 	Error beginRequest(const char *host, const char *path);
 
+	/**
+	 * Sends datagram over UDP to host, a name like in beginRequest(), and
+	 * port, a number as a string. It is sent again if no reply comes
+	 * within a few seconds. The socket is kept open, so the next datagrams
+	 * to the same host go right away
+	 */
+	Error sendDatagram(const char *host, const char *port, const char *datagram);
+
+	/**
+	 * Returns the reply to the last datagram, or the start of the last
+	 * HTTP response, as a string once readyForCommands() without error.
+	 * Replies are cut to 31 bytes. The next command overwrites it
+	 */
+	const char *getReply();
+
 	/**
 	 *  Sends an SMS message. Number must be in international format 
 	 **/
@@ -191,6 +357,22 @@ public:
 	 */
 	Error receiveUnreadMessages(MessageCallback callback, void *data);
 
+	/**
+	 * Turns the radio off with AT+CFUN=0, which drops the PDP context.
+	 * readyForCommands() is false until wakeUp() sets it up again
+	 */
+	Error sleep();
+
+	/**
+	 * Turns the radio on with AT+CFUN=1 and sets up the PDP context
+	 */
+	Error wakeUp();
+
+	/**
+	 * Returns true if the radio is off or being turned off
+	 */
+	bool isAsleep();
+
 	/**
 	 * Read from the cell serial port and behaves accordingly 
 	 * Should be called in each loop() iteration
@@ -231,23 +413,69 @@ private:
 		const StringHelper &nextMessage3 = (char *)NULL,
 		const StringHelper &nextMessage4 = (char *)NULL,
 		const StringHelper &nextMessage5 = (char *)NULL);
+
+	// Writes the parts of a command in the cell and the standard Serial port
+	void sendCommand(
+		const StringHelper &part1,
+		const StringHelper &part2 = (char *)NULL,
+		const StringHelper &part3 = (char *)NULL,
+		const StringHelper &part4 = (char *)NULL,
+		const StringHelper &part5 = (char *)NULL);
+
+	// Returns true for ERROR and +CME ERROR result codes
+	static bool isErrorMessage(const String &message);
 	
 	// Short functions that implements the behaviour
 
+	bool hasValidAddress();
+	void waitForModule(char incomingChar);
+	void probeModule();
+	void verifyPDPContext();
+	void verifyPDPContextStep(char incomingChar);
+	void moduleReady(State nextState);
+	void continueSetUp();
+	void setUpPDPContext(bool queryAttach);
+	void setUpPDPContextChainStep(char incomingChar);
+	void startDNSConnection();
+	void startHostConnection();
+	void startConnectionChainStep(char incomingChar, State nextState);
+	void refuseChain();
+	void waitForRestart();
+	bool isWaitingForRemote();
+	void setBaudRateStep(char incomingChar);
+	void verifyBaudRate();
+	void verifyBaudRateStep(char incomingChar);
+	void switchBaudRate(long rate);
 	void waitForSetUp(char incomingChar);
 	void queryConnStatusWaitForConnection(char incomingChar, State nextState);
+	void readConnectionStatus(const String &lastMessage, State nextState);
 	void queryConnStatusWaitForOK(char incomingChar, const char *connectionId, int dataLength, State noConnState, State openConnState);
 	void sendPacketDataSendData(char incomingChar);
 	void sendDNSRequest(char incomingChar);
 	int  getDNSRequestPacketLength();
-	int  getRawRequestDataLength();
+	// Writes the GET request into out and returns its length. Without out
+	// only the length is returned, so it always matches the bytes sent
+	size_t writeRequest(Print *out);
+	static size_t writeFragment(Print *out, const char *fragment, size_t length);
+	static size_t writeField(Print *out, const char *field);
 	void readDNSSDataPrefix(char incomingChar);
 	void readDNSHeaderStatus(char incomingChar);
 	void setUpSkipDNSAnswer();
-	void skipResponseBytes(char incomingChar, State nextState);
-	void readDNSFirstAnswer(char incomingChar);
+	void skipResponseBytes(char incomingChar);
+	void readDNSAnswer(char incomingChar);
+	void nextDNSAnswer();
+	void askSecondaryDNS();
+	void connectNextAddress();
+	void sendDatagramLength();
+	void readReplySDataPrefix(char incomingChar);
+	void readReply(char incomingChar);
+	void replyRead();
+	// Returns true for a "HTTP/1.x 2xx" status line
+	static bool isSuccessStatus(const char *reply);
 	void readUntilEndLine(char incomingChar, State nextStatus, bool hasError);
 	void configureRemoteHost(char incomingChar);
+	void configureDNSHost(char incomingChar);
+	void wakeUpStep(char incomingChar);
 	void setSMSMessage(char incomingChar);
 	void readMessageHeader(char incomingChar);
 	void readMessageBody(char incomingChar);
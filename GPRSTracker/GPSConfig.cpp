@@ -0,0 +1,353 @@
+// 
+// 
+// 
+
+#include "GPSConfig.h"
+
+const unsigned long ACK_TIMEOUT = 1000;
+
+// Time given to the receiver to switch its baud rate
+const unsigned long BAUD_RATE_SWITCH_DELAY = 100;
+
+// PMTK001 flag of a command that succeeded
+const char *ACK_SUCCEEDED = "3";
+
+// Sentence rates in fixes for GLL, RMC, VTG, GGA, GSA and GSV, then the
+// rest of the PMTK314 fields. GSA and GSV are off unless TinyGPS++Config.h
+// asks TinyGPSPlus to parse them, then they go once each 5 fixes
+#if _GPS_PARSE_GSA
+#define _PMTK_GSA_RATE "5"
+#else
+#define _PMTK_GSA_RATE "0"
+#endif
+#if _GPS_PARSE_GSV
+#define _PMTK_GSV_RATE "5"
+#else
+#define _PMTK_GSV_RATE "0"
+#endif
+#define _PMTK_SET_SENTENCES "PMTK314,0,1,0,1," _PMTK_GSA_RATE "," _PMTK_GSV_RATE ",0,0,0,0,0,0,0,0,0,0,0,0,0"
+
+GPSConfig::GPSConfig(SoftwareSerial &gpsSerial, TinyGPSPlus &gps, long baudRate, unsigned int updateInterval) :
+	gpsSerial(gpsSerial),
+	gps(gps),
+	baudRate(baudRate),
+	updateInterval(updateInterval),
+	ackCommand(gps, "PMTK001", 1),
+	ackFlag(gps, "PMTK001", 2),
+	state(IDLE),
+	lastError(NO_ERROR),
+	currentBaudRate(DEFAULT_BAUD_RATE),
+	hasReference(false),
+	referenceLat(0),
+	referenceLng(0),
+	referenceAltitude(0),
+	referenceTime(0)
+{
+}
+
+void GPSConfig::setReferencePosition(int32_t lat, int32_t lng, int16_t altitude, uint32_t time)
+{
+	hasReference = true;
+	referenceLat = lat;
+	referenceLng = lng;
+	referenceAltitude = altitude;
+	referenceTime = time;
+}
+
+void GPSConfig::begin()
+{
+	lastError = NO_ERROR;
+	currentBaudRate = DEFAULT_BAUD_RATE;
+	gpsSerial.begin(currentBaudRate);
+	gpsSerial.listen();
+
+	if (baudRate == DEFAULT_BAUD_RATE)
+	{
+		setSentences(SET_SENTENCES);
+		return;
+	}
+
+	// The acknowledge would come at the new baud rate, the next command
+	// tells if the switch worked
+	sendCommand(F("PMTK251,"), baudRate);
+	success(SWITCH_BAUD_RATE, BAUD_RATE_SWITCH_DELAY);
+}
+
+void GPSConfig::loop()
+{
+	if (gpsSerial.available() > 0)
+	{
+		gps.encode(gpsSerial.read());
+	}
+
+	switch (state)
+	{
+	case SWITCH_BAUD_RATE:
+		if (timer.wasExpired())
+		{
+			currentBaudRate = baudRate;
+			gpsSerial.begin(currentBaudRate);
+			setSentences(SET_SENTENCES);
+		}
+		break;
+	case SET_SENTENCES:
+		switch (acknowledged("314"))
+		{
+		case ACCEPTED:
+			setUpdateRate();
+			break;
+		case REFUSED:
+			fail(SENTENCES_NOT_ACKNOWLEDGED, DONE);
+			break;
+		case TIMED_OUT:
+			if (currentBaudRate != DEFAULT_BAUD_RATE)
+			{
+				// The receiver did not switch, go on at the default rate
+				lastError = BAUD_RATE_NOT_ACKNOWLEDGED;
+				currentBaudRate = DEFAULT_BAUD_RATE;
+				gpsSerial.begin(currentBaudRate);
+				setSentences(SET_SENTENCES_DEFAULT_BAUD_RATE);
+			}
+			else
+			{
+				fail(SENTENCES_NOT_ACKNOWLEDGED, DONE);
+			}
+			break;
+		default:
+			break;
+		}
+		break;
+	case SET_SENTENCES_DEFAULT_BAUD_RATE:
+		// 9600 baud cannot carry the faster update rate, keep the default
+		switch (acknowledged("314"))
+		{
+		case ACCEPTED:
+			setReferencePosition();
+			break;
+		case REFUSED:
+		case TIMED_OUT:
+			fail(SENTENCES_NOT_ACKNOWLEDGED, DONE);
+			break;
+		default:
+			break;
+		}
+		break;
+	case SET_UPDATE_RATE:
+		switch (acknowledged("220"))
+		{
+		case ACCEPTED:
+			setReferencePosition();
+			break;
+		case REFUSED:
+		case TIMED_OUT:
+			fail(UPDATE_RATE_NOT_ACKNOWLEDGED, DONE);
+			setReferencePosition();
+			break;
+		default:
+			break;
+		}
+		break;
+	case SET_REFERENCE_POSITION:
+		switch (acknowledged("741"))
+		{
+		case ACCEPTED:
+			success(DONE, 0);
+			break;
+		case REFUSED:
+		case TIMED_OUT:
+			fail(REFERENCE_POSITION_NOT_ACKNOWLEDGED, DONE);
+			break;
+		default:
+			break;
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+bool GPSConfig::isDone()
+{
+	return state == DONE;
+}
+
+GPSConfig::Error GPSConfig::getLastError()
+{
+	return lastError;
+}
+
+long GPSConfig::getBaudRate()
+{
+	return currentBaudRate;
+}
+
+void GPSConfig::standby()
+{
+	sendCommand(F("PMTK161,0"));
+}
+
+void GPSConfig::wakeUp()
+{
+	// The test command, it does nothing
+	sendCommand(F("PMTK000"));
+}
+
+void GPSConfig::sendCommand(const __FlashStringHelper *command, long argument)
+{
+	char buffer[64];
+	strncpy_P(buffer, (const char *)command, sizeof(buffer) - 12);
+	buffer[sizeof(buffer) - 12] = '\0';
+	if (argument >= 0)
+	{
+		ltoa(argument, buffer + strlen(buffer), 10);
+	}
+	sendCommand(buffer);
+}
+
+void GPSConfig::sendCommand(const char *command)
+{
+	uint8_t checksum = 0;
+	for (const char *c = command; *c; ++c)
+	{
+		checksum ^= *c;
+	}
+
+	gpsSerial.print('$');
+	gpsSerial.print(command);
+	gpsSerial.print('*');
+	if (checksum < 0x10)
+	{
+		gpsSerial.print('0');
+	}
+	gpsSerial.print(checksum, HEX);
+	gpsSerial.print(F("\r\n"));
+
+	Serial.print(F("GPS: "));
+	Serial.println(command);
+
+	// Drops the acknowledge of a previous command
+	ackCommand.value();
+	ackFlag.value();
+}
+
+GPSConfig::Acknowledge GPSConfig::acknowledged(const char *command)
+{
+	// Both terms are committed together, with the checksum
+	if (ackFlag.isUpdated())
+	{
+		bool isCommand = strcmp(ackCommand.value(), command) == 0;
+		bool succeeded = strcmp(ackFlag.value(), ACK_SUCCEEDED) == 0;
+		if (isCommand)
+		{
+			return succeeded ? ACCEPTED : REFUSED;
+		}
+	}
+
+	return timer.wasExpired() ? TIMED_OUT : WAITING;
+}
+
+void GPSConfig::setSentences(State nextState)
+{
+	sendCommand(F(_PMTK_SET_SENTENCES));
+	success(nextState, ACK_TIMEOUT);
+}
+
+void GPSConfig::setUpdateRate()
+{
+	sendCommand(F("PMTK220,"), updateInterval);
+	success(SET_UPDATE_RATE, ACK_TIMEOUT);
+}
+
+// Writes value / 10^7 with 7 decimals at the end of buffer
+static void appendE7(char *buffer, int32_t value)
+{
+	buffer += strlen(buffer);
+	if (value < 0)
+	{
+		*buffer++ = '-';
+	}
+	uint32_t magnitude = value < 0 ? -(uint32_t)value : value;
+	ultoa(magnitude / 10000000UL, buffer, 10);
+	buffer += strlen(buffer);
+	*buffer++ = '.';
+	uint32_t fraction = magnitude % 10000000UL;
+	for (uint32_t digit = 1000000UL; digit > 0; digit /= 10)
+	{
+		*buffer++ = '0' + fraction / digit % 10;
+	}
+	*buffer = '\0';
+}
+
+// Writes ',' and value with at least two digits at the end of buffer
+static void appendField(char *buffer, long value)
+{
+	buffer += strlen(buffer);
+	*buffer++ = ',';
+	if (value < 10)
+	{
+		*buffer++ = '0';
+	}
+	ltoa(value, buffer, 10);
+}
+
+void GPSConfig::setReferencePosition()
+{
+	if (!hasReference)
+	{
+		success(DONE, 0);
+		return;
+	}
+
+	// Civil date from days since 1970-01-01
+	uint32_t days = referenceTime / 86400UL;
+	uint32_t seconds = referenceTime % 86400UL;
+	uint32_t shifted = days + 719468UL;
+	uint32_t era = shifted / 146097UL;
+	uint32_t dayOfEra = shifted - era * 146097UL;
+	uint32_t yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+	uint32_t dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+	uint32_t shiftedMonth = (5 * dayOfYear + 2) / 153;
+	uint8_t day = dayOfYear - (153 * shiftedMonth + 2) / 5 + 1;
+	uint8_t month = shiftedMonth < 10 ? shiftedMonth + 3 : shiftedMonth - 9;
+	uint16_t year = yearOfEra + era * 400 + (month <= 2);
+
+	// PMTK741,<lat>,<lng>,<altitude>,<year>,<month>,<day>,<hour>,<minute>,<second>
+	char buffer[64];
+	strcpy_P(buffer, PSTR("PMTK741,"));
+	appendE7(buffer, referenceLat);
+	strcat(buffer, ",");
+	appendE7(buffer, referenceLng);
+	strcat(buffer, ",");
+	ltoa(referenceAltitude, buffer + strlen(buffer), 10);
+	appendField(buffer, year);
+	appendField(buffer, month);
+	appendField(buffer, day);
+	appendField(buffer, seconds / 3600);
+	appendField(buffer, seconds / 60 % 60);
+	appendField(buffer, seconds % 60);
+
+	sendCommand(buffer);
+	success(SET_REFERENCE_POSITION, ACK_TIMEOUT);
+}
+
+void GPSConfig::fail(Error error, State nextState)
+{
+	if (lastError == NO_ERROR)
+	{
+		lastError = error;
+	}
+	success(nextState, 0);
+}
+
+void GPSConfig::success(State newState, unsigned long timeout)
+{
+	state = newState;
+	if (timeout > 0)
+	{
+		timer.setTimeout(timeout);
+	}
+	else
+	{
+		timer.removeTimeout();
+	}
+}
@@ -0,0 +1,155 @@
+// GPSConfig.h
+
+#ifndef _GPSCONFIG_h
+#define _GPSCONFIG_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+	#include "Arduino.h"
+#else
+	#include "WProgram.h"
+#endif
+
+#include "Timer.h"
+#include "TinyGPS++.h"
+#include <SoftwareSerial.h>
+
+#if !_GPS_HAS_FIELD(_GPS_FIELD_CUSTOM)
+#error "GPSConfig reads the acknowledges with TinyGPSCustom, _GPS_FIELDS must have _GPS_FIELD_CUSTOM"
+#endif
+#if _GPS_MAX_CUSTOM_TERMS < 3
+#error "GPSConfig reads the PMTK001 terms 1 and 2, _GPS_MAX_CUSTOM_TERMS must be at least 3"
+#endif
+
+/**
+ * Configures a MediaTek (PMTK) receiver at startup: raises the baud rate,
+ * limits the output to the sentences TinyGPSPlus decodes and sets the
+ * update rate. Each command is verified with the PMTK001 acknowledge,
+ * read through custom elements of the TinyGPSPlus object, so it needs
+ * _GPS_FIELD_CUSTOM.
+ *
+ * Failures are not fatal: if the receiver does not answer at the new baud
+ * rate the configuration goes on at the default one, keeping the default
+ * update rate, and if it does not answer at all it is left untouched.
+ */
+class GPSConfig
+{
+public:
+	enum Error {
+		NO_ERROR = 0,
+		BAUD_RATE_NOT_ACKNOWLEDGED,
+		SENTENCES_NOT_ACKNOWLEDGED,
+		UPDATE_RATE_NOT_ACKNOWLEDGED,
+		REFERENCE_POSITION_NOT_ACKNOWLEDGED
+	};
+
+	// Baud rate of the receiver after a power up
+	static const long DEFAULT_BAUD_RATE = 9600;
+
+	/**
+	 * baudRate is the one to switch to and updateInterval the time between
+	 * fixes in milliseconds, 100 or more
+	 */
+	GPSConfig(SoftwareSerial &gpsSerial, TinyGPSPlus &gps, long baudRate, unsigned int updateInterval);
+
+	/**
+	 * Sets a position known from before, in ten millionths of a degree and
+	 * meters, at time in seconds since 1970-01-01 UTC. It is sent after the
+	 * configuration with PMTK741 to shorten the time to first fix. Must be
+	 * called before begin()
+	 */
+	void setReferencePosition(int32_t lat, int32_t lng, int16_t altitude, uint32_t time);
+
+	/**
+	 * Opens gpsSerial at the default baud rate, listens to it and starts
+	 * the configuration. loop() must be called until isDone()
+	 */
+	void begin();
+
+	/**
+	 * Reads one character from the receiver into the TinyGPSPlus object and
+	 * advances the configuration
+	 */
+	void loop();
+
+	/**
+	 * Returns true when the configuration finished, with or without errors
+	 */
+	bool isDone();
+
+	/**
+	 * Returns the first command that was not acknowledged
+	 */
+	Error getLastError();
+
+	/**
+	 * Returns the baud rate gpsSerial was left at
+	 */
+	long getBaudRate();
+
+	/**
+	 * Puts the receiver in standby with PMTK161. It keeps its configuration
+	 * and ephemeris, so it gets a fix again within seconds of wakeUp()
+	 */
+	void standby();
+
+	/**
+	 * Wakes the receiver from standby, any byte does it
+	 */
+	void wakeUp();
+
+private:
+	enum State {
+		IDLE,
+		SWITCH_BAUD_RATE,
+		SET_SENTENCES,
+		SET_SENTENCES_DEFAULT_BAUD_RATE,
+		SET_UPDATE_RATE,
+		SET_REFERENCE_POSITION,
+		DONE
+	};
+
+	enum Acknowledge {
+		WAITING,
+		ACCEPTED,
+		REFUSED,
+		TIMED_OUT
+	};
+
+	SoftwareSerial &gpsSerial;
+	TinyGPSPlus &gps;
+	long baudRate;
+	unsigned int updateInterval;
+
+	// PMTK001,<command>,<flag>
+	TinyGPSCustom ackCommand;
+	TinyGPSCustom ackFlag;
+
+	State state;
+	Error lastError;
+	long currentBaudRate;
+	Timer timer;
+
+	// Position given to setReferencePosition()
+	bool hasReference;
+	int32_t referenceLat;
+	int32_t referenceLng;
+	int16_t referenceAltitude;
+	uint32_t referenceTime;
+
+	// Sends $<command><argument>*<checksum>, argument is not sent if < 0
+	void sendCommand(const __FlashStringHelper *command, long argument = -1);
+	// Sends $<command>*<checksum>
+	void sendCommand(const char *command);
+
+	// Checks the PMTK001 acknowledge of command, e.g. "314"
+	Acknowledge acknowledged(const char *command);
+
+	void setSentences(State nextState);
+	void setUpdateRate();
+	void setReferencePosition();
+	void fail(Error error, State nextState);
+	void success(State newState, unsigned long timeout);
+};
+
+#endif
+
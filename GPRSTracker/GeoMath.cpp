@@ -0,0 +1,124 @@
+// 
+// 
+// 
+
+#include "GeoMath.h"
+
+// Meters per E7 unit on a sphere of radius 6371 km is 0.0111195, this is
+// the same value scaled by 65536
+const int32_t METERS_PER_E7_Q16 = 729;
+
+// sin() in Q15 every 5 degrees, from 0 to 90
+const PROGMEM int16_t SIN_TABLE[] = {
+	0, 2856, 5690, 8481, 11207, 13848, 16383, 18794, 21062, 23170,
+	25101, 26841, 28377, 29697, 30791, 31650, 32269, 32642, 32767
+};
+
+const int32_t CENTIDEGREES_PER_STEP = 500;
+
+int32_t GeoMath::toE7(const RawDegrees &degrees)
+{
+	int32_t result = degrees.deg * 10000000L + degrees.billionths / 100;
+	return degrees.negative ? -result : result;
+}
+
+uint16_t GeoMath::cosLatQ15(int32_t latE7)
+{
+	return (uint16_t)(cos(radians(latE7 / 10000000.0)) * 32767.0);
+}
+
+int16_t GeoMath::sinQ15(int32_t centidegrees)
+{
+	centidegrees %= 36000;
+	if (centidegrees < 0)
+	{
+		centidegrees += 36000;
+	}
+
+	// Fold into the first quadrant
+	bool negative = centidegrees >= 18000;
+	if (negative)
+	{
+		centidegrees -= 18000;
+	}
+	if (centidegrees > 9000)
+	{
+		centidegrees = 18000 - centidegrees;
+	}
+
+	uint8_t step = centidegrees / CENTIDEGREES_PER_STEP;
+	int32_t result = (int16_t)pgm_read_word(&SIN_TABLE[step]);
+	int32_t fraction = centidegrees % CENTIDEGREES_PER_STEP;
+	if (fraction)
+	{
+		int32_t next = (int16_t)pgm_read_word(&SIN_TABLE[step + 1]);
+		result += (next - result) * fraction / CENTIDEGREES_PER_STEP;
+	}
+
+	return negative ? -result : result;
+}
+
+int16_t GeoMath::cosQ15(int32_t centidegrees)
+{
+	return sinQ15(centidegrees + 9000);
+}
+
+bool GeoMath::localOffset(int32_t lat1, int32_t lng1, int32_t lat2, int32_t lng2, uint16_t cosLat, int16_t &north, int16_t &east)
+{
+	// Unsigned subtraction so a far away point wraps instead of overflowing
+	int32_t deltaLat = (int32_t)((uint32_t)lat2 - (uint32_t)lat1);
+	int32_t deltaLng = (int32_t)((uint32_t)lng2 - (uint32_t)lng1);
+
+	if (deltaLat > MAX_LOCAL_DELTA_E7 || deltaLat < -MAX_LOCAL_DELTA_E7 ||
+		deltaLng > MAX_LOCAL_DELTA_E7 || deltaLng < -MAX_LOCAL_DELTA_E7)
+	{
+		return false;
+	}
+
+	north = deltaLat * METERS_PER_E7_Q16 / 65536L;
+	east = (deltaLng * METERS_PER_E7_Q16 / 65536L) * (int32_t)cosLat / 32768L;
+	return true;
+}
+
+GeoMath::Reference::Reference() :
+	lat(0),
+	lng(0),
+	cosLat(1)
+{
+}
+
+GeoMath::Reference::Reference(double lat, double lng)
+{
+	set(lat, lng);
+}
+
+void GeoMath::Reference::set(double lat, double lng)
+{
+	this->lat = lat;
+	this->lng = lng;
+	cosLat = cos(radians(lat));
+}
+
+double GeoMath::Reference::distanceTo(double lat, double lng) const
+{
+	double deltaLng = lng - this->lng;
+	if (deltaLng > 180.0)
+	{
+		deltaLng -= 360.0;
+	}
+	else if (deltaLng < -180.0)
+	{
+		deltaLng += 360.0;
+	}
+
+	// Same sphere radius as TinyGPSPlus::distanceBetween()
+	double x = radians(deltaLng) * cosLat;
+	double y = radians(lat - this->lat);
+	double distance = sqrt(x * x + y * y) * 6372795;
+
+	if (distance > MAX_FLAT_DISTANCE)
+	{
+		return TinyGPSPlus::distanceBetween(this->lat, this->lng, lat, lng);
+	}
+	return distance;
+}
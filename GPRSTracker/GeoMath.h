@@ -0,0 +1,91 @@
+// GeoMath.h
+
+#ifndef _GEOMATH_h
+#define _GEOMATH_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+	#include "Arduino.h"
+#else
+	#include "WProgram.h"
+#endif
+
+#include "TinyGPS++.h"
+
+/**
+ * Integer geometry helpers. Coordinates are signed ten millionths of a
+ * degree (E7), which keeps about 1 cm of resolution in an int32_t.
+ * Local distances use a flat projection around a reference latitude and
+ * are given in whole meters.
+ */
+namespace GeoMath
+{
+	// Largest coordinate difference accepted by the local projection, about
+	// 32 km in latitude. Larger differences do not fit the fixed point math
+	const int32_t MAX_LOCAL_DELTA_E7 = 2900000L;
+
+	/**
+	 * Converts a TinyGPS++ raw coordinate to E7
+	 */
+	int32_t toE7(const RawDegrees &degrees);
+
+	/**
+	 * Returns cos(latitude) in Q15 (32767 is 1.0). Evaluates the cosine
+	 * once, keep the result while the reference point does not change
+	 */
+	uint16_t cosLatQ15(int32_t latE7);
+
+	/**
+	 * Returns false if the points are too far apart for the local
+	 * projection. Otherwise stores in north and east the meters from
+	 * (lat1, lng1) to (lat2, lng2), using cosLat of the reference point
+	 */
+	bool localOffset(int32_t lat1, int32_t lng1, int32_t lat2, int32_t lng2, uint16_t cosLat, int16_t &north, int16_t &east);
+
+	/**
+	 * Returns sin(angle) in Q15, angle in hundredths of a degree. Uses a
+	 * table with linear interpolation, the error is below 0.001
+	 */
+	int16_t sinQ15(int32_t centidegrees);
+
+	/**
+	 * Returns cos(angle) in Q15, angle in hundredths of a degree
+	 */
+	int16_t cosQ15(int32_t centidegrees);
+
+	// Distances up to this many meters use the flat approximation
+	const double MAX_FLAT_DISTANCE = 10000.0;
+
+	/**
+	 * Fast replacement of TinyGPSPlus::distanceBetween() for many distances
+	 * from the same point. cos(latitude) of the reference is computed once,
+	 * then each distance is an equirectangular approximation with one sqrt
+	 * and no trigonometry. Up to MAX_FLAT_DISTANCE and 70 degrees of
+	 * latitude it differs less than 0.1% (10 m) from the great circle, as
+	 * tests/GeoMathTest.cpp checks. Longer distances fall back to
+	 * TinyGPSPlus::distanceBetween().
+	 */
+	class Reference
+	{
+	 public:
+		Reference();
+		Reference(double lat, double lng);
+
+		/**
+		 * Moves the reference point, evaluates one cosine
+		 */
+		void set(double lat, double lng);
+
+		/**
+		 * Returns the distance in meters from the reference point
+		 */
+		double distanceTo(double lat, double lng) const;
+
+	 private:
+		double lat;
+		double lng;
+		double cosLat;
+	};
+}
+
+#endif
+
@@ -0,0 +1,126 @@
+// 
+// 
+// 
+
+#include "Geofence.h"
+#include "GeoMath.h"
+
+Geofence::Geofence(const GeofenceZone *zones, uint8_t zoneCount, ZoneCallback callback, void *data) :
+	zones(zones),
+	zoneCount(zoneCount > GEOFENCE_MAX_ZONES ? GEOFENCE_MAX_ZONES : zoneCount),
+	callback(callback),
+	callbackData(data),
+	initialized(false)
+{
+	memset(insideBits, 0, sizeof(insideBits));
+}
+
+void Geofence::update(const TinyGPSFix &fix)
+{
+	if (!fix.isValid(TinyGPSFix::LOCATION))
+	{
+		return;
+	}
+
+	int32_t lat = GeoMath::toE7(fix.rawLat);
+	int32_t lng = GeoMath::toE7(fix.rawLng);
+	uint16_t cosLat = GeoMath::cosLatQ15(lat);
+
+	for (uint8_t i = 0; i < zoneCount; ++i)
+	{
+		GeofenceZone zone;
+		memcpy_P(&zone, &zones[i], sizeof(zone));
+
+		bool inside = zone.vertexCount == 0 ?
+			containsCircle(zone, lat, lng, cosLat) :
+			containsPolygon(zone, lat, lng, cosLat);
+
+		uint8_t mask = 1 << (i & 7);
+		bool wasInside = insideBits[i >> 3] & mask;
+		if (inside == wasInside)
+		{
+			continue;
+		}
+
+		if (inside)
+		{
+			insideBits[i >> 3] |= mask;
+		}
+		else
+		{
+			insideBits[i >> 3] &= ~mask;
+		}
+
+		if (initialized && callback)
+		{
+			callback(callbackData, zone.id, inside);
+		}
+	}
+
+	initialized = true;
+}
+
+bool Geofence::isInside(uint8_t index) const
+{
+	return index < zoneCount && (insideBits[index >> 3] & (1 << (index & 7)));
+}
+
+bool Geofence::containsCircle(const GeofenceZone &zone, int32_t lat, int32_t lng, uint16_t cosLat)
+{
+	int16_t north, east;
+	if (!GeoMath::localOffset(zone.center.lat, zone.center.lng, lat, lng, cosLat, north, east))
+	{
+		return false;
+	}
+
+	uint32_t squaredDistance = (uint32_t)((int32_t)north * north) + (uint32_t)((int32_t)east * east);
+	return squaredDistance <= (uint32_t)zone.radius * zone.radius;
+}
+
+bool Geofence::containsPolygon(const GeofenceZone &zone, int32_t lat, int32_t lng, uint16_t cosLat)
+{
+	if (lat < zone.boxMin.lat || lat > zone.boxMax.lat ||
+		lng < zone.boxMin.lng || lng > zone.boxMax.lng)
+	{
+		return false;
+	}
+
+	// Crossing number of a ray going east from the location, with the
+	// vertices projected to meters around the location
+	bool inside = false;
+	int16_t previousNorth, previousEast;
+	GeofencePoint vertex;
+
+	memcpy_P(&vertex, &zone.vertices[zone.vertexCount - 1], sizeof(vertex));
+	if (!GeoMath::localOffset(lat, lng, vertex.lat, vertex.lng, cosLat, previousNorth, previousEast))
+	{
+		return false;
+	}
+
+	for (uint8_t i = 0; i < zone.vertexCount; ++i)
+	{
+		int16_t north, east;
+		memcpy_P(&vertex, &zone.vertices[i], sizeof(vertex));
+		if (!GeoMath::localOffset(lat, lng, vertex.lat, vertex.lng, cosLat, north, east))
+		{
+			return false;
+		}
+
+		if ((north > 0) != (previousNorth > 0))
+		{
+			// The edge crosses the ray if it intersects the east axis at a
+			// positive x, that is the cross product has the sign of the
+			// north difference
+			int32_t cross = (int32_t)previousEast * north - (int32_t)previousNorth * east;
+			if ((cross > 0) == (north > previousNorth))
+			{
+				inside = !inside;
+			}
+		}
+
+		previousNorth = north;
+		previousEast = east;
+	}
+
+	return inside;
+}
@@ -0,0 +1,80 @@
+// Geofence.h
+
+#ifndef _GEOFENCE_h
+#define _GEOFENCE_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+	#include "Arduino.h"
+#else
+	#include "WProgram.h"
+#endif
+
+#include <avr/pgmspace.h>
+#include "TinyGPS++.h"
+
+const uint8_t GEOFENCE_MAX_ZONES = 64;
+
+// Coordinates in ten millionths of a degree, see GeoMath
+struct GeofencePoint
+{
+	int32_t lat;
+	int32_t lng;
+};
+
+/**
+ * A circle (vertexCount == 0) around center, or a polygon whose vertices
+ * are a PROGMEM array. boxMin and boxMax must enclose the polygon vertices,
+ * they are not used for circles. Zones must be smaller than about 30 km.
+ */
+struct GeofenceZone
+{
+	uint8_t id;
+	uint8_t vertexCount;
+	uint16_t radius;
+	GeofencePoint center;
+	GeofencePoint boxMin;
+	GeofencePoint boxMax;
+	const GeofencePoint *vertices;
+};
+
+/**
+ * Evaluates the current location against a PROGMEM table of zones and
+ * calls back when the vehicle enters or leaves one of them. The first
+ * evaluation only sets the initial state and raises no events.
+ */
+class Geofence
+{
+ public:
+	typedef void(*ZoneCallback)(void *data, uint8_t zoneId, bool entered);
+
+	/**
+	 * zones is a PROGMEM array of up to GEOFENCE_MAX_ZONES zones
+	 */
+	Geofence(const GeofenceZone *zones, uint8_t zoneCount, ZoneCallback callback, void *data);
+
+	/**
+	 * Evaluates all zones against the location of fix and raises the events
+	 */
+	void update(const TinyGPSFix &fix);
+
+	/**
+	 * Returns true if the last evaluated location was inside the zone
+	 * at index (not id)
+	 */
+	bool isInside(uint8_t index) const;
+
+ private:
+	const GeofenceZone *zones;
+	uint8_t zoneCount;
+	ZoneCallback callback;
+	void *callbackData;
+
+	bool initialized;
+	uint8_t insideBits[(GEOFENCE_MAX_ZONES + 7) / 8];
+
+	static bool containsCircle(const GeofenceZone &zone, int32_t lat, int32_t lng, uint16_t cosLat);
+	static bool containsPolygon(const GeofenceZone &zone, int32_t lat, int32_t lng, uint16_t cosLat);
+};
+
+#endif
+
@@ -0,0 +1,337 @@
+// 
+// 
+// 
+
+#include "KalmanSmoother.h"
+#include "GeoMath.h"
+
+// Variances are capped so the products in predict() fit 32 bits. This is a
+// standard deviation of 181 m or 181 m/s, well above the receiver error so
+// a capped prediction still follows the next fix
+const int32_t MAX_VARIANCE = 1L << 23;
+
+// Receiver error in meters for each HDOP unit. HDOP * 100 is kept within
+// these bounds, and DEFAULT_HDOP is assumed when the receiver did not
+// report it
+const int32_t UERE = 5;
+const int32_t MIN_HDOP = 50;
+const int32_t MAX_HDOP = 2000;
+const int32_t DEFAULT_HDOP = 200;
+
+// Variance of each velocity axis measured from speed and course, 0.5 m/s
+const int32_t VELOCITY_VARIANCE = 64;
+
+// Variance of each velocity axis when the filter starts without speed and
+// course, 45 m/s
+const int32_t UNKNOWN_VELOCITY_VARIANCE = 1L << 19;
+
+// Beyond 8 km the origin moves to the vehicle
+const int32_t MAX_ORIGIN_DISTANCE = 8000L * 16;
+
+// Time steps are sixty fourths of a second
+const int32_t STEPS_PER_SECOND = 64;
+
+static int32_t clampVariance(int32_t variance)
+{
+	return variance > MAX_VARIANCE ? MAX_VARIANCE : variance < 0 ? 0 : variance;
+}
+
+static int32_t clampCovariance(int32_t covariance)
+{
+	return covariance > MAX_VARIANCE ? MAX_VARIANCE :
+		covariance < -MAX_VARIANCE ? -MAX_VARIANCE : covariance;
+}
+
+// value * factor / 32768 for |value| < 2^30 and |factor| < 2^16
+static int32_t mulQ15(int32_t value, int32_t factor)
+{
+	bool negative = (value < 0) != (factor < 0);
+	uint32_t a = value < 0 ? -value : value;
+	uint32_t b = factor < 0 ? -factor : factor;
+	int32_t result = (a >> 15) * b + (((a & 0x7FFF) * b) >> 15);
+	return negative ? -result : result;
+}
+
+// numerator / denominator in Q15, clamped to (-2, 2). denominator > 0
+static int32_t ratioQ15(int32_t numerator, int32_t denominator)
+{
+	while (denominator > 0xFFFF)
+	{
+		denominator >>= 1;
+		numerator >>= 1;
+	}
+
+	int32_t whole = numerator / denominator;
+	if (whole > 1)
+	{
+		return 65535;
+	}
+	if (whole < -1)
+	{
+		return -65535;
+	}
+	return whole * 32768 + (numerator % denominator) * 32768 / denominator;
+}
+
+// Sixteenths of a meter to ten millionths of a degree of latitude, the
+// inverse of the 729 / 65536 meters per unit of GeoMath. In two parts so
+// the product fits 32 bits
+static int32_t positionToE7(int32_t position)
+{
+	return position / 729 * 4096 + position % 729 * 4096 / 729;
+}
+
+// delta must be within GeoMath::MAX_LOCAL_DELTA_E7
+static int32_t e7ToPosition(int32_t delta)
+{
+	return delta * 729 / 4096;
+}
+
+static uint32_t squareRoot(uint32_t value)
+{
+	uint32_t root = 0;
+	uint32_t bit = 1UL << 30;
+	while (bit > value)
+	{
+		bit >>= 2;
+	}
+	while (bit)
+	{
+		if (value >= root + bit)
+		{
+			value -= root + bit;
+			root = (root >> 1) + bit;
+		}
+		else
+		{
+			root >>= 1;
+		}
+		bit >>= 2;
+	}
+	return root;
+}
+
+void KalmanSmoother::Axis::reset(int32_t position, int32_t velocity, int32_t positionVariance, int32_t velocityVariance)
+{
+	this->position = position;
+	this->velocity = velocity;
+	p00 = clampVariance(positionVariance);
+	p01 = 0;
+	p11 = clampVariance(velocityVariance);
+}
+
+// steps is at most STEPS_PER_SECOND. noise is the acceleration variance,
+// added as the white noise acceleration model
+void KalmanSmoother::Axis::predict(int32_t steps, int32_t noise)
+{
+	position += velocity * steps / STEPS_PER_SECOND;
+
+	int32_t noise1 = noise * steps / STEPS_PER_SECOND;
+	int32_t noise2 = noise1 * steps / STEPS_PER_SECOND;
+	int32_t noise3 = noise2 * steps / STEPS_PER_SECOND;
+
+	p00 = clampVariance(p00 + (2 * p01 + p11 * steps / STEPS_PER_SECOND) * steps / STEPS_PER_SECOND + noise3 / 3);
+	p01 = clampCovariance(p01 + p11 * steps / STEPS_PER_SECOND + noise2 / 2);
+	p11 = clampVariance(p11 + noise1);
+}
+
+// Predicts a second at a time, the products overflow over longer steps.
+// Returns false if a variance reached MAX_VARIANCE: the capped covariance
+// no longer relates position and velocity, and a correction with it would
+// throw the velocity off
+bool KalmanSmoother::Axis::predictInterval(int32_t steps, int32_t noise)
+{
+	while (steps > 0)
+	{
+		predict(steps < STEPS_PER_SECOND ? steps : STEPS_PER_SECOND, noise);
+		if (p00 == MAX_VARIANCE || p11 == MAX_VARIANCE)
+		{
+			return false;
+		}
+		steps -= STEPS_PER_SECOND;
+	}
+	return true;
+}
+
+void KalmanSmoother::Axis::correctPosition(int32_t measured, int32_t variance)
+{
+	int32_t total = p00 + variance;
+	int32_t positionGain = ratioQ15(p00, total);
+	int32_t velocityGain = ratioQ15(p01, total);
+	int32_t innovation = measured - position;
+
+	position += mulQ15(innovation, positionGain);
+	velocity += mulQ15(innovation, velocityGain);
+
+	p11 = clampVariance(p11 - mulQ15(p01, velocityGain));
+	p01 -= mulQ15(p01, positionGain);
+	p00 = clampVariance(p00 - mulQ15(p00, positionGain));
+}
+
+void KalmanSmoother::Axis::correctVelocity(int32_t measured, int32_t variance)
+{
+	int32_t total = p11 + variance;
+	int32_t positionGain = ratioQ15(p01, total);
+	int32_t velocityGain = ratioQ15(p11, total);
+	int32_t innovation = measured - velocity;
+
+	position += mulQ15(innovation, positionGain);
+	velocity += mulQ15(innovation, velocityGain);
+
+	p00 = clampVariance(p00 - mulQ15(p01, positionGain));
+	p01 -= mulQ15(p01, velocityGain);
+	p11 = clampVariance(p11 - mulQ15(p11, velocityGain));
+}
+
+KalmanSmoother::KalmanSmoother(unsigned int acceleration) :
+	hasState(false),
+	originLat(0),
+	originLng(0),
+	originCosLat(32767),
+	lastCommitTime(0),
+	lastTime(0)
+{
+	// cm/s2 to the square of sixteenths of a meter per s2
+	if (acceleration > 1000)
+	{
+		acceleration = 1000;
+	}
+	noise = (int32_t)acceleration * acceleration * 256 / 10000;
+}
+
+void KalmanSmoother::update(const TinyGPSFix &fix)
+{
+	if (hasState && fix.isValid(TinyGPSFix::TIME) && fix.time == lastTime)
+	{
+		return;
+	}
+
+	int32_t lat = GeoMath::toE7(fix.rawLat);
+	int32_t lng = GeoMath::toE7(fix.rawLng);
+	int32_t deltaLat = lat - originLat;
+	int32_t deltaLng = lng - originLng;
+	unsigned long interval = fix.commitTime - lastCommitTime;
+
+	if (!hasState || interval > MAX_INTERVAL ||
+		deltaLat > GeoMath::MAX_LOCAL_DELTA_E7 || deltaLat < -GeoMath::MAX_LOCAL_DELTA_E7 ||
+		deltaLng > GeoMath::MAX_LOCAL_DELTA_E7 || deltaLng < -GeoMath::MAX_LOCAL_DELTA_E7)
+	{
+		start(fix, lat, lng);
+		return;
+	}
+
+	int32_t steps = interval * STEPS_PER_SECOND / 1000;
+	if (!north.predictInterval(steps, noise) || !east.predictInterval(steps, noise))
+	{
+		start(fix, lat, lng);
+		return;
+	}
+
+	int32_t variance = positionVariance(fix);
+	north.correctPosition(e7ToPosition(deltaLat), variance);
+	east.correctPosition(mulQ15(e7ToPosition(deltaLng), originCosLat), variance);
+
+	int32_t northVelocity, eastVelocity;
+	if (velocity(fix, northVelocity, eastVelocity))
+	{
+		north.correctVelocity(northVelocity, VELOCITY_VARIANCE);
+		east.correctVelocity(eastVelocity, VELOCITY_VARIANCE);
+	}
+
+	lastCommitTime = fix.commitTime;
+	lastTime = fix.time;
+
+	if (north.position > MAX_ORIGIN_DISTANCE || north.position < -MAX_ORIGIN_DISTANCE ||
+		east.position > MAX_ORIGIN_DISTANCE || east.position < -MAX_ORIGIN_DISTANCE)
+	{
+		moveOrigin();
+	}
+}
+
+void KalmanSmoother::reset()
+{
+	hasState = false;
+}
+
+int32_t KalmanSmoother::lat() const
+{
+	return originLat + positionToE7(north.position);
+}
+
+int32_t KalmanSmoother::lng() const
+{
+	// Divides by cos(latitude) in two parts so the product fits 32 bits
+	int32_t delta = positionToE7(east.position);
+	return originLng + delta / originCosLat * 32768 + delta % originCosLat * 32768 / originCosLat;
+}
+
+unsigned int KalmanSmoother::uncertainty() const
+{
+	return squareRoot(north.p00 + east.p00) / 16;
+}
+
+void KalmanSmoother::start(const TinyGPSFix &fix, int32_t lat, int32_t lng)
+{
+	originLat = lat;
+	originLng = lng;
+	originCosLat = GeoMath::cosLatQ15(lat);
+
+	int32_t variance = positionVariance(fix);
+	int32_t northVelocity = 0;
+	int32_t eastVelocity = 0;
+	int32_t velocityVariance = UNKNOWN_VELOCITY_VARIANCE;
+	if (velocity(fix, northVelocity, eastVelocity))
+	{
+		velocityVariance = VELOCITY_VARIANCE;
+	}
+
+	north.reset(0, northVelocity, variance, velocityVariance);
+	east.reset(0, eastVelocity, variance, velocityVariance);
+
+	lastCommitTime = fix.commitTime;
+	lastTime = fix.time;
+	hasState = true;
+}
+
+void KalmanSmoother::moveOrigin()
+{
+	int32_t lat = this->lat();
+	int32_t lng = this->lng();
+
+	originLat = lat;
+	originLng = lng;
+	originCosLat = GeoMath::cosLatQ15(lat);
+	north.position = 0;
+	east.position = 0;
+}
+
+bool KalmanSmoother::velocity(const TinyGPSFix &fix, int32_t &northVelocity, int32_t &eastVelocity)
+{
+	if (!fix.isValid(TinyGPSFix::SPEED | TinyGPSFix::COURSE))
+	{
+		return false;
+	}
+
+	// Knots * 100 to sixteenths of a meter per second
+	int32_t speed = fix.speed * 8231L / 100000L;
+	northVelocity = speed * GeoMath::cosQ15(fix.course) / 32768L;
+	eastVelocity = speed * GeoMath::sinQ15(fix.course) / 32768L;
+	return true;
+}
+
+int32_t KalmanSmoother::positionVariance(const TinyGPSFix &fix)
+{
+	int32_t hdop = fix.isValid(TinyGPSFix::HDOP) ? fix.hdop : DEFAULT_HDOP;
+	if (hdop < MIN_HDOP)
+	{
+		hdop = MIN_HDOP;
+	}
+	else if (hdop > MAX_HDOP)
+	{
+		hdop = MAX_HDOP;
+	}
+
+	// Half of (UERE * HDOP)^2 in each axis, times 256 for the square of
+	// sixteenths of a meter
+	return clampVariance(UERE * UERE * 128 * hdop / 10000 * hdop);
+}
@@ -0,0 +1,106 @@
+// KalmanSmoother.h
+
+#ifndef _KALMANSMOOTHER_h
+#define _KALMANSMOOTHER_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+	#include "Arduino.h"
+#else
+	#include "WProgram.h"
+#endif
+
+#include "TinyGPS++.h"
+
+/**
+ * Constant velocity Kalman filter that smooths the receiver positions.
+ * North and east are filtered independently, each with a position and a
+ * velocity and their 2x2 covariance. Everything is fixed point: positions
+ * in sixteenths of a meter relative to an origin that follows the
+ * vehicle, velocities in sixteenths of a meter per second and variances
+ * in the square of those units.
+ *
+ * Positions are weighted by HDOP, and speed and course are fed as a
+ * velocity measurement. The GPS is not read while uploading, so the filter
+ * keeps predicting across gaps between fixes, with a covariance that grows
+ * with the gap. It restarts when a variance no longer fits the fixed point
+ * range, after about 30 s with an acceleration of 200 cm/s2 and sooner
+ * with larger ones, or after MAX_INTERVAL milliseconds.
+ */
+class KalmanSmoother
+{
+ public:
+	static const unsigned long MAX_INTERVAL = 60000;
+
+	/**
+	 * acceleration is the standard deviation of the vehicle acceleration
+	 * in cm/s2, up to 1000. Larger values follow turns and stops sooner,
+	 * smaller ones smooth more
+	 */
+	KalmanSmoother(unsigned int acceleration);
+
+	/**
+	 * Feeds a fix with a valid location. When RMC and GGA report the same
+	 * position only the first one is used
+	 */
+	void update(const TinyGPSFix &fix);
+
+	/**
+	 * Forgets the state, the next fix starts the filter again
+	 */
+	void reset();
+
+	bool isValid() const { return hasState; }
+
+	/**
+	 * Smoothed position in ten millionths of a degree
+	 */
+	int32_t lat() const;
+	int32_t lng() const;
+
+	/**
+	 * Standard deviation of the smoothed position in meters
+	 */
+	unsigned int uncertainty() const;
+
+ private:
+	struct Axis
+	{
+		int32_t position;
+		int32_t velocity;
+		int32_t p00, p01, p11;
+
+		void reset(int32_t position, int32_t velocity, int32_t positionVariance, int32_t velocityVariance);
+		void predict(int32_t steps, int32_t noise);
+		bool predictInterval(int32_t steps, int32_t noise);
+		void correctPosition(int32_t measured, int32_t variance);
+		void correctVelocity(int32_t measured, int32_t variance);
+	};
+
+	int32_t noise;
+
+	bool hasState;
+	int32_t originLat;
+	int32_t originLng;
+	uint16_t originCosLat;
+	unsigned long lastCommitTime;
+	uint32_t lastTime;
+
+	Axis north;
+	Axis east;
+
+	// Starts the filter at fix, with the origin on it
+	void start(const TinyGPSFix &fix, int32_t lat, int32_t lng);
+
+	// Moves the origin to the current position
+	void moveOrigin();
+
+	// Stores in northVelocity and eastVelocity the speed and course of
+	// fix. Returns false if they are not valid
+	static bool velocity(const TinyGPSFix &fix, int32_t &northVelocity, int32_t &eastVelocity);
+
+	// Variance of each axis of the position of fix
+	static int32_t positionVariance(const TinyGPSFix &fix);
+};
+
+#endif
+
@@ -0,0 +1,82 @@
+// 
+// 
+// 
+
+#include "PersistentState.h"
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+
+PersistentState::PersistentState(uint16_t address, uint8_t slotCount) :
+	address(address),
+	slotCount(slotCount),
+	current(slotCount - 1),
+	sequence(0)
+{
+	memset(&data, 0, sizeof(data));
+}
+
+bool PersistentState::load()
+{
+	bool found = false;
+	Slot contents;
+
+	for (uint8_t slot = 0; slot < slotCount; ++slot)
+	{
+		if (!readSlot(slot, contents))
+		{
+			continue;
+		}
+
+		// Serial number arithmetic, the sequence wraps around
+		if (!found || (int16_t)(contents.sequence - sequence) > 0)
+		{
+			found = true;
+			current = slot;
+			sequence = contents.sequence;
+			data = contents.data;
+		}
+	}
+
+	if (!found)
+	{
+		memset(&data, 0, sizeof(data));
+	}
+	return found;
+}
+
+void PersistentState::save()
+{
+	current = (current + 1) % slotCount;
+
+	Slot contents;
+	contents.sequence = ++sequence;
+	data.layout = LAYOUT_VERSION;
+	contents.data = data;
+	contents.crc = crc(contents);
+
+	// Only the bytes that changed are written
+	eeprom_update_block(&contents, (void *)(uintptr_t)slotAddress(current), sizeof(contents));
+}
+
+uint16_t PersistentState::slotAddress(uint8_t slot)
+{
+	return address + slot * sizeof(Slot);
+}
+
+bool PersistentState::readSlot(uint8_t slot, Slot &contents)
+{
+	eeprom_read_block(&contents, (const void *)(uintptr_t)slotAddress(slot), sizeof(contents));
+	return contents.crc == crc(contents) && contents.data.layout == LAYOUT_VERSION;
+}
+
+uint16_t PersistentState::crc(const Slot &contents)
+{
+	// An erased EEPROM reads 0xFF, the initial value makes such a slot fail
+	uint16_t result = 0xFFFF;
+	const uint8_t *bytes = (const uint8_t *)&contents;
+	for (size_t i = 0; i < offsetof(Slot, crc); ++i)
+	{
+		result = _crc_ccitt_update(result, bytes[i]);
+	}
+	return result;
+}
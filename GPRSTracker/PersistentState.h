@@ -0,0 +1,98 @@
+// PersistentState.h
+
+#ifndef _PERSISTENTSTATE_h
+#define _PERSISTENTSTATE_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+	#include "Arduino.h"
+#else
+	#include "WProgram.h"
+#endif
+
+/**
+ * State kept in EEPROM across resets, so a restart does not begin from
+ * scratch. The block is written each time to the next of a ring of slots
+ * to spread the wear, and the slot with the highest sequence number and a
+ * valid CRC is the current one. A write cut by a reset leaves a bad CRC,
+ * so the previous slot is used. Slots written with another layout of Data
+ * are ignored, so a firmware update starts from scratch instead of
+ * misreading them.
+ */
+class PersistentState
+{
+public:
+	// Changes each time the fields of Data or the EEPROM areas of the
+	// sketch change
+	static const uint8_t LAYOUT_VERSION = 2;
+
+	struct Data
+	{
+		// LAYOUT_VERSION when the slot was written, set by save()
+		uint8_t layout;
+
+		// Last accepted fix, ten millionths of a degree, meters and
+		// seconds since 1970-01-01 UTC. fixTime is 0 if there is no fix
+		int32_t lat;
+		int32_t lng;
+		int16_t altitude;
+		uint32_t fixTime;
+
+		// Last resolved server address, valid until ipExpiry in seconds
+		// since 1970-01-01 UTC
+		uint8_t ip[4];
+		uint32_t ipExpiry;
+
+		// GPRS::configurationChecksum() of the PDP context set up last
+		uint16_t pdpChecksum;
+
+		// Baud rate the modem was left at, 0 if unknown
+		int32_t modemBaudRate;
+
+		// Fix queue positions
+		uint16_t queueHead;
+		uint16_t queueTail;
+	};
+
+	/**
+	 * Uses slotCount slots from EEPROM address on, each sizeof(Data) + 4
+	 * bytes long
+	 */
+	PersistentState(uint16_t address, uint8_t slotCount);
+
+	/**
+	 * Reads the current slot into data. Returns false and clears data if no
+	 * slot is valid and of LAYOUT_VERSION
+	 */
+	bool load();
+
+	/**
+	 * Writes data into the next slot. It takes a few milliseconds for each
+	 * changed byte
+	 */
+	void save();
+
+	Data data;
+
+private:
+	struct Slot
+	{
+		uint16_t sequence;
+		Data data;
+		uint16_t crc;
+	};
+
+	uint16_t address;
+	uint8_t slotCount;
+
+	// Slot and sequence number last read or written
+	uint8_t current;
+	uint16_t sequence;
+
+	uint16_t slotAddress(uint8_t slot);
+	bool readSlot(uint8_t slot, Slot &contents);
+
+	static uint16_t crc(const Slot &contents);
+};
+
+#endif
+
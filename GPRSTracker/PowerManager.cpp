@@ -0,0 +1,101 @@
+// 
+// 
+// 
+
+#include "PowerManager.h"
+#include <avr/sleep.h>
+
+PowerManager::PowerManager(GPRS &gprs, GPSConfig &gpsConfig, bool gpsStandby, unsigned long wakeUpLead, unsigned long minSleep) :
+	gprs(gprs),
+	gpsConfig(gpsConfig),
+	gpsStandby(gpsStandby),
+	wakeUpLead(wakeUpLead),
+	minSleep(minSleep),
+	state(AWAKE)
+{
+}
+
+bool PowerManager::sleep(unsigned long deadline)
+{
+	if (state != AWAKE || deadline < wakeUpLead + minSleep)
+	{
+		return false;
+	}
+
+	if (gprs.sleep() != GPRS::NO_ERROR)
+	{
+		return false;
+	}
+	if (gpsStandby)
+	{
+		gpsConfig.standby();
+	}
+
+	Serial.print(F("<<Sleeping "));
+	Serial.print((deadline - wakeUpLead) / 1000);
+	Serial.println(F(" s>>"));
+
+	timer.setTimeout(deadline - wakeUpLead);
+	state = SLEEPING;
+	return true;
+}
+
+void PowerManager::loop()
+{
+	gprs.loop();
+
+	switch (state)
+	{
+	case SLEEPING:
+		if (timer.wasExpired())
+		{
+			wakeUp();
+		}
+		else if (gprs.isAsleep() && !gprs.isExpectingResponse())
+		{
+			idle();
+		}
+		break;
+	case WAKING_UP:
+		if (gprs.readyForCommands())
+		{
+			Serial.println(F("<<Awake>>"));
+			state = AWAKE;
+		}
+		else if (!gprs.isExpectingResponse())
+		{
+			// The PDP context setup failed, it is tried again
+			gprs.wakeUp();
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+void PowerManager::wakeUp()
+{
+	if (state != SLEEPING)
+	{
+		return;
+	}
+
+	gprs.wakeUp();
+	if (gpsStandby)
+	{
+		gpsConfig.wakeUp();
+	}
+	timer.removeTimeout();
+	state = WAKING_UP;
+}
+
+bool PowerManager::isAwake()
+{
+	return state == AWAKE;
+}
+
+void PowerManager::idle()
+{
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	sleep_mode();
+}
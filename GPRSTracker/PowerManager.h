@@ -0,0 +1,79 @@
+// PowerManager.h
+
+#ifndef _POWERMANAGER_h
+#define _POWERMANAGER_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+	#include "Arduino.h"
+#else
+	#include "WProgram.h"
+#endif
+
+#include "Timer.h"
+#include "GPRS.h"
+#include "GPSConfig.h"
+
+/**
+ * Sleeps between reports of a parked vehicle. The modem radio is turned
+ * off, the GPS receiver optionally put in standby and the MCU idled
+ * until wakeUpLead before the deadline. That gives the modem time to
+ * register and set up its PDP context, and the receiver time for a fix.
+ *
+ * The MCU only goes to SLEEP_MODE_IDLE: timer 0 keeps millis() and the
+ * Timer objects running, and SoftwareSerial still gets its pin change
+ * interrupts. Each timer 0 tick wakes the MCU, which sleeps again on the
+ * next loop().
+ */
+class PowerManager
+{
+public:
+	/**
+	 * wakeUpLead and minSleep are in milliseconds. Sleeps shorter than
+	 * minSleep are not worth turning the radio off
+	 */
+	PowerManager(GPRS &gprs, GPSConfig &gpsConfig, bool gpsStandby, unsigned long wakeUpLead, unsigned long minSleep);
+
+	/**
+	 * Starts sleeping if the deadline, in milliseconds from now, leaves
+	 * enough time. Returns false if it does not. gprs must be ready for
+	 * commands
+	 */
+	bool sleep(unsigned long deadline);
+
+	/**
+	 * Idles the MCU while sleeping and wakes everything up in time.
+	 * Should be called in each loop() iteration while not awake
+	 */
+	void loop();
+
+	/**
+	 * Wakes up before the deadline
+	 */
+	void wakeUp();
+
+	/**
+	 * Returns true when not sleeping and the modem is ready for commands
+	 */
+	bool isAwake();
+
+private:
+	enum State {
+		AWAKE,
+		SLEEPING,
+		WAKING_UP
+	};
+
+	GPRS &gprs;
+	GPSConfig &gpsConfig;
+	bool gpsStandby;
+	unsigned long wakeUpLead;
+	unsigned long minSleep;
+
+	State state;
+	Timer timer;
+
+	static void idle();
+};
+
+#endif
+
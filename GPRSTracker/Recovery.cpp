@@ -0,0 +1,181 @@
+// 
+// 
+// 
+
+#include "Recovery.h"
+
+// Time the modem supply is cut for
+const unsigned long POWER_OFF_TIME = 2000;
+
+Recovery::Recovery(GPRS &gprs, uint8_t powerPin, unsigned long baseDelay, unsigned long maxDelay) :
+	gprs(gprs),
+	powerPin(powerPin),
+	baseDelay(baseDelay),
+	maxDelay(maxDelay),
+	state(IDLE),
+	action(RETRY),
+	failures(0)
+{
+}
+
+void Recovery::begin()
+{
+	if (powerPin != NO_POWER_PIN)
+	{
+		pinMode(powerPin, OUTPUT);
+		digitalWrite(powerPin, HIGH);
+	}
+}
+
+Recovery::Kind Recovery::classify(GPRS::Error error)
+{
+	switch (error)
+	{
+	case(GPRS::NO_ERROR):
+		return NONE;
+	case(GPRS::DNS_NO_ANSWER):
+	case(GPRS::CONNECT_FAILED):
+		return DNS;
+	case(GPRS::PDP_NOT_PREPARED):
+		return PDP;
+	case(GPRS::MODULE_NOT_RESPONDING):
+		return MODEM_HUNG;
+	default:
+		// Including the configuration errors, nothing but a retry would
+		// change them
+		return TRANSIENT;
+	}
+}
+
+void Recovery::failed(GPRS::Error error)
+{
+	if (failures < 255)
+	{
+		++failures;
+	}
+	action = chooseAction(classify(error));
+
+	unsigned long wait = backoff();
+	Serial.print(F("<<Recovery "));
+	Serial.print(action);
+	Serial.print(F(" in "));
+	Serial.print(wait / 1000);
+	Serial.println(F(" s>>"));
+
+	timer.setTimeout(wait);
+	state = BACKING_OFF;
+}
+
+void Recovery::succeeded()
+{
+	failures = 0;
+}
+
+void Recovery::loop()
+{
+	switch (state)
+	{
+	case(BACKING_OFF):
+		if (timer.wasExpired())
+		{
+			apply();
+		}
+		break;
+	case(POWER_OFF):
+		if (timer.wasExpired())
+		{
+			digitalWrite(powerPin, HIGH);
+			gprs.powerCycled();
+			state = FIXING;
+		}
+		break;
+	case(FIXING):
+		if (gprs.readyForCommands())
+		{
+			state = IDLE;
+		}
+		else if (gprs.getLastError() != GPRS::NO_ERROR)
+		{
+			// The fix failed as well, the next one is tried
+			failed(gprs.getLastError());
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+bool Recovery::isReady()
+{
+	return state == IDLE && gprs.readyForCommands();
+}
+
+Recovery::Action Recovery::chooseAction(Kind kind)
+{
+	int action = RETRY;
+	switch (kind)
+	{
+	case(DNS):
+		action = RESOLVE_AGAIN;
+		break;
+	case(PDP):
+		action = RESET_PDP;
+		break;
+	case(MODEM_HUNG):
+		action = SOFT_RESET;
+		break;
+	default:
+		break;
+	}
+
+	action += (failures - 1) / FAILURES_PER_STEP;
+
+	// Without a PDP context there is nothing to retry with
+	if (!gprs.readyForCommands() && action < RESET_PDP)
+	{
+		action = RESET_PDP;
+	}
+
+	Action last = powerPin != NO_POWER_PIN ? POWER_CYCLE : SOFT_RESET;
+	return action < last ? (Action)action : last;
+}
+
+unsigned long Recovery::backoff()
+{
+	unsigned long wait = baseDelay;
+	for (uint8_t i = 1; i < failures && wait < maxDelay; ++i)
+	{
+		wait *= 2;
+	}
+	if (wait > maxDelay)
+	{
+		wait = maxDelay;
+	}
+
+	return wait / 2 + random(wait / 2 + 1);
+}
+
+void Recovery::apply()
+{
+	state = FIXING;
+
+	switch (action)
+	{
+	case(RESOLVE_AGAIN):
+		gprs.forgetAddress();
+		break;
+	case(RESET_PDP):
+		gprs.resetPDPContext();
+		break;
+	case(SOFT_RESET):
+		gprs.restart();
+		break;
+	case(POWER_CYCLE):
+		digitalWrite(powerPin, LOW);
+		timer.setTimeout(POWER_OFF_TIME);
+		state = POWER_OFF;
+		break;
+	default:
+		break;
+	}
+}
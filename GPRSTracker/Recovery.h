@@ -0,0 +1,114 @@
+// Recovery.h
+
+#ifndef _RECOVERY_h
+#define _RECOVERY_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+	#include "Arduino.h"
+#else
+	#include "WProgram.h"
+#endif
+
+#include "Timer.h"
+#include "GPRS.h"
+
+/**
+ * Gets the modem working again after a failed operation. Each error is
+ * classified and the cheapest fix for its kind is applied: a retry, a new
+ * DNS query, setting the PDP context up again, a reset with AT+CFUN=1,1
+ * or cutting the modem supply. Consecutive failures escalate to the next
+ * fix each FAILURES_PER_STEP failures.
+ *
+ * Fixes are applied after a backoff that doubles with each consecutive
+ * failure up to maxDelay. Half of it is random, so trackers that lost the
+ * network together do not retry together.
+ */
+class Recovery
+{
+public:
+	enum Kind {
+		NONE,
+		// Socket errors and timeouts while the network answers slowly
+		TRANSIENT,
+		DNS,
+		PDP,
+		MODEM_HUNG
+	};
+
+	// From the cheapest to the most expensive
+	enum Action {
+		RETRY,
+		RESOLVE_AGAIN,
+		RESET_PDP,
+		SOFT_RESET,
+		POWER_CYCLE
+	};
+
+	// Passed as powerPin if nothing switches the modem supply
+	static const uint8_t NO_POWER_PIN = 255;
+
+	/**
+	 * powerPin switches the modem supply, HIGH is on. The delays are in
+	 * milliseconds
+	 */
+	Recovery(GPRS &gprs, uint8_t powerPin, unsigned long baseDelay, unsigned long maxDelay);
+
+	/**
+	 * Turns the modem supply on. Must be called from setup()
+	 */
+	void begin();
+
+	/**
+	 * Returns the kind of an error
+	 */
+	static Kind classify(GPRS::Error error);
+
+	/**
+	 * Schedules the fix for error after the backoff
+	 */
+	void failed(GPRS::Error error);
+
+	/**
+	 * Resets the backoff and the escalation after a successful operation
+	 */
+	void succeeded();
+
+	/**
+	 * Applies the fix once the backoff elapsed and follows it up. Must be
+	 * called in each loop() iteration while not ready, along gprs.loop()
+	 */
+	void loop();
+
+	/**
+	 * Returns true when no fix is pending and gprs is ready for commands
+	 */
+	bool isReady();
+
+private:
+	enum State {
+		IDLE,
+		BACKING_OFF,
+		// Waiting for gprs to finish the fix
+		FIXING,
+		POWER_OFF
+	};
+
+	// Consecutive failures before the next fix is tried
+	static const uint8_t FAILURES_PER_STEP = 2;
+
+	GPRS &gprs;
+	uint8_t powerPin;
+	unsigned long baseDelay;
+	unsigned long maxDelay;
+
+	State state;
+	Action action;
+	uint8_t failures;
+	Timer timer;
+
+	Action chooseAction(Kind kind);
+	unsigned long backoff();
+	void apply();
+};
+
+#endif
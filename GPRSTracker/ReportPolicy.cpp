@@ -0,0 +1,100 @@
+// 
+// 
+// 
+
+#include "ReportPolicy.h"
+
+ReportPolicy::ReportPolicy(unsigned int minDistance, unsigned int minCourseChange, unsigned long heartbeat, unsigned int minSpeed) :
+	minDistance(minDistance),
+	minCourseChange(minCourseChange),
+	heartbeat(heartbeat),
+	minSpeed(minSpeed),
+	hasReported(false),
+	hasLastFix(false),
+	lastLat(0),
+	lastLng(0),
+	lastCourse(-1)
+{
+}
+
+bool ReportPolicy::shouldReport(const TinyGPSFix &fix)
+{
+	if (!hasLastFix || heartbeatDue())
+	{
+		return true;
+	}
+
+	double lat = fix.lat();
+	double lng = fix.lng();
+
+	// A bad HDOP makes the position wander, so require a longer jump
+	unsigned long threshold = minDistance;
+	if (fix.isValid(TinyGPSFix::HDOP))
+	{
+		threshold += METERS_PER_HDOP * fix.hdop / 100;
+	}
+
+	if (lastFix.distanceTo(lat, lng) >= threshold)
+	{
+		return true;
+	}
+
+	int course = heading(fix, lat, lng);
+	return course >= 0 && lastCourse >= 0 &&
+		courseDifference(course, lastCourse) >= minCourseChange;
+}
+
+bool ReportPolicy::heartbeatDue()
+{
+	return !hasReported || heartbeatTimer.wasExpired();
+}
+
+unsigned long ReportPolicy::timeToHeartbeat()
+{
+	return hasReported ? heartbeatTimer.remaining() : 0;
+}
+
+void ReportPolicy::reported(const TinyGPSFix &fix)
+{
+	if (fix.isValid(TinyGPSFix::LOCATION))
+	{
+		double lat = fix.lat();
+		double lng = fix.lng();
+
+		lastCourse = heading(fix, lat, lng);
+		lastFix.set(lat, lng);
+		lastLat = lat;
+		lastLng = lng;
+		hasLastFix = true;
+	}
+
+	hasReported = true;
+	heartbeatTimer.setTimeout(heartbeat);
+}
+
+int ReportPolicy::heading(const TinyGPSFix &fix, double lat, double lng)
+{
+	// Knots * 100 to km/h
+	if (!fix.isValid(TinyGPSFix::SPEED) || fix.speed * 1852L / 100000L < (long)minSpeed)
+	{
+		return -1;
+	}
+
+	if (fix.isValid(TinyGPSFix::COURSE))
+	{
+		return fix.course / 100;
+	}
+
+	if (hasLastFix)
+	{
+		return (int)TinyGPSPlus::courseTo(lastLat, lastLng, lat, lng);
+	}
+
+	return -1;
+}
+
+unsigned int ReportPolicy::courseDifference(int course1, int course2)
+{
+	int difference = abs(course1 - course2) % 360;
+	return difference > 180 ? 360 - difference : difference;
+}
@@ -0,0 +1,83 @@
+// ReportPolicy.h
+
+#ifndef _REPORTPOLICY_h
+#define _REPORTPOLICY_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+	#include "Arduino.h"
+#else
+	#include "WProgram.h"
+#endif
+
+#include "Timer.h"
+#include "TinyGPS++.h"
+#include "GeoMath.h"
+
+/**
+ * Decides which fixes are worth uploading. A fix is reported when the
+ * vehicle moved far enough from the last reported position, when its
+ * heading changed while moving, or when the heartbeat interval elapsed.
+ * A parked vehicle only produces heartbeats.
+ */
+class ReportPolicy
+{
+ public:
+	/**
+	 * minDistance is in meters, minCourseChange in degrees and heartbeat
+	 * in milliseconds. Course changes are ignored below minSpeed (km/h)
+	 * because the receiver course is noise when standing still.
+	 */
+	ReportPolicy(unsigned int minDistance, unsigned int minCourseChange, unsigned long heartbeat, unsigned int minSpeed);
+
+	/**
+	 * Returns true if fix should be uploaded
+	 */
+	bool shouldReport(const TinyGPSFix &fix);
+
+	/**
+	 * Returns true if nothing was reported during the heartbeat interval,
+	 * so a report must be sent even without a new fix
+	 */
+	bool heartbeatDue();
+
+	/**
+	 * Returns the milliseconds until the next heartbeat, 0 if it is due
+	 */
+	unsigned long timeToHeartbeat();
+
+	/**
+	 * Remembers fix as the last reported one and restarts the heartbeat
+	 * interval
+	 */
+	void reported(const TinyGPSFix &fix);
+
+ private:
+	// Meters of position jitter allowed for each HDOP unit
+	static const unsigned int METERS_PER_HDOP = 5;
+
+	unsigned int minDistance;
+	unsigned int minCourseChange;
+	unsigned long heartbeat;
+	unsigned int minSpeed;
+
+	// Last reported fix
+	bool hasReported;
+	bool hasLastFix;
+	GeoMath::Reference lastFix;
+	double lastLat;
+	double lastLng;
+	int lastCourse;
+
+	Timer heartbeatTimer;
+
+	// Heading of the vehicle in degrees or -1 if it is not moving. Uses
+	// the receiver course, or the course from the last reported fix when
+	// the receiver did not provide one
+	int heading(const TinyGPSFix &fix, double lat, double lng);
+
+	// Absolute difference between two headings in degrees, in [0, 180]
+	static unsigned int courseDifference(int course1, int course2);
+};
+
+#endif
+
@@ -24,3 +24,9 @@ bool Timer::wasExpired()
 	//return false;
 	return hasTimeout && millis() > timeout;
 }
+
+unsigned long Timer::remaining()
+{
+	unsigned long now = millis();
+	return hasTimeout && now < timeout ? timeout - now : 0;
+}
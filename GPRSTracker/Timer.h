@@ -19,6 +19,8 @@ class Timer
 	void removeTimeout();
 	void setTimeout(unsigned long milliseconds);
 	bool wasExpired();
+	// Milliseconds until the timeout expires, 0 if it expired or is not set
+	unsigned long remaining();
 };
 
 #endif
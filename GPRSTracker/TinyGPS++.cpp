@@ -31,6 +31,8 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #define _GNRMCterm   "GNRMC"
 #define _GPGGAterm   "GPGGA"
 #define _GNGGAterm   "GNGGA"
+#define _GSVterm     "GSV"
+#define _GSAterm     "GSA"
 
 TinyGPSPlus::TinyGPSPlus()
   :  parity(0)
@@ -38,15 +40,27 @@ TinyGPSPlus::TinyGPSPlus()
   ,  curSentenceType(GPS_SENTENCE_OTHER)
   ,  curTermNumber(0)
   ,  curTermOffset(0)
+  ,  curTermParser(GPS_TERM_COPY)
+  ,  curTermCopied(true)
   ,  sentenceHasFix(false)
-  ,  customElts(0)
-  ,  customCandidates(0)
+#if _GPS_HAS_FIELD(_GPS_FIELD_CUSTOM)
+  ,  customSentenceCount(0)
+  ,  curCustomSentence(-1)
+#endif
+#if _GPS_HAS_FIELD(_GPS_FIELD_DATE) && _GPS_HAS_FIELD(_GPS_FIELD_TIME)
+  ,  dateDaySeconds(0)
+#endif
+  ,  fixCallback(0)
+  ,  fixCallbackData(0)
   ,  encodedCharCount(0)
   ,  sentencesWithFixCount(0)
   ,  failedChecksumCount(0)
   ,  passedChecksumCount(0)
 {
   term[0] = '\0';
+#if _GPS_HAS_FIELD(_GPS_FIELD_CUSTOM)
+  memset(customTerms, 0, sizeof(customTerms));
+#endif
 }
 
 //
@@ -74,6 +88,7 @@ bool TinyGPSPlus::encode(char c)
       ++curTermNumber;
       curTermOffset = 0;
       isChecksumTerm = c == '*';
+      beginTerm();
       return isValidSentence;
     }
     break;
@@ -84,11 +99,28 @@ bool TinyGPSPlus::encode(char c)
     curSentenceType = GPS_SENTENCE_OTHER;
     isChecksumTerm = false;
     sentenceHasFix = false;
+    beginTerm();
     return false;
 
   default: // ordinary characters
     if (curTermOffset < sizeof(term) - 1)
-      term[curTermOffset++] = c;
+    {
+      switch(curTermParser)
+      {
+      case GPS_TERM_DECIMAL:
+        decimalParser.feed(c);
+        break;
+      case GPS_TERM_DEGREES:
+        degreesParser.feed(c);
+        break;
+      case GPS_TERM_COPY:
+      case GPS_TERM_SKIP:
+        break;
+      }
+      if (curTermCopied)
+        term[curTermOffset] = c;
+      ++curTermOffset;
+    }
     if (!isChecksumTerm)
       parity ^= c;
     return false;
@@ -111,48 +143,141 @@ int TinyGPSPlus::fromHex(char a)
 }
 
 // static
-// Parse a (potentially negative) number with up to 2 decimal digits -xxxx.yy
-int32_t TinyGPSPlus::parseDecimal(const char *term)
-{
-  bool negative = *term == '-';
-  if (negative) ++term;
-  int32_t ret = 100 * (int32_t)atol(term);
-  while (isdigit(*term)) ++term;
-  if (*term == '.' && isdigit(term[1]))
-  {
-    ret += 10 * (term[1] - '0');
-    if (isdigit(term[2]))
-      ret += term[2] - '0';
-  }
-  return negative ? -ret : ret;
+// Parse a (potentially negative) number with up to "decimals" decimal digits -xxxx.yy
+int32_t TinyGPSPlus::parseDecimal(const char *term, uint8_t decimals)
+{
+  TinyGPSDecimalParser parser;
+  parser.begin(decimals);
+  while (*term)
+    parser.feed(*term++);
+  return parser.value();
 }
 
 // static
 // Parse degrees in that funny NMEA format DDMM.MMMM
 void TinyGPSPlus::parseDegrees(const char *term, RawDegrees &deg)
 {
-  uint32_t leftOfDecimal = (uint32_t)atol(term);
-  uint16_t minutes = (uint16_t)(leftOfDecimal % 100);
-  uint32_t multiplier = 10000000UL;
-  uint32_t tenMillionthsOfMinutes = minutes * multiplier;
+  TinyGPSDegreesParser parser;
+  while (*term)
+    parser.feed(*term++);
+  parser.value(deg);
+}
+
+#if _GPS_PARSE_GSV || _GPS_PARSE_GSA
+// Mask of the TinyGPSSatellites systems a talker reports, 0 if the
+// sentence does not come from a GPS, GLONASS, Galileo or combined talker
+static uint8_t talkerSystems(const char *term)
+{
+  if (term[0] != 'G')
+    return 0;
+  switch(term[1])
+  {
+  case 'P':
+    return 1 << TinyGPSSatellites::GPS;
+  case 'L':
+    return 1 << TinyGPSSatellites::GLONASS;
+  case 'A':
+    return 1 << TinyGPSSatellites::GALILEO;
+  case 'N':
+    return (1 << TinyGPSSatellites::GPS) | (1 << TinyGPSSatellites::GLONASS) |
+      (1 << TinyGPSSatellites::GALILEO);
+  }
+  return 0;
+}
+#endif
 
-  deg.deg = (int16_t)(leftOfDecimal / 100);
+#define COMBINE(sentence_type, term_number) (((unsigned)(sentence_type) << 5) | term_number)
 
-  while (isdigit(*term))
-    ++term;
+// Prepares the parsing of the term that starts: numeric fields of known
+// sentences go through the parsers, flags and unknown terms are copied into
+// term, and fields left out of _GPS_FIELDS are skipped
+void TinyGPSPlus::beginTerm()
+{
+  curTermParser = GPS_TERM_COPY;
 
-  if (*term == '.')
-    while (isdigit(*++term))
+  if (!isChecksumTerm && curTermNumber > 0)
+  {
+    if (curSentenceType != GPS_SENTENCE_OTHER)
+      curTermParser = GPS_TERM_SKIP;
+
+    switch(COMBINE(curSentenceType, curTermNumber))
     {
-      multiplier /= 10;
-      tenMillionthsOfMinutes += (*term - '0') * multiplier;
+#if _GPS_HAS_FIELD(_GPS_FIELD_TIME)
+    case COMBINE(GPS_SENTENCE_GPRMC, 1): // Time in both sentences
+    case COMBINE(GPS_SENTENCE_GPGGA, 1):
+#endif
+#if _GPS_HAS_FIELD(_GPS_FIELD_SPEED)
+    case COMBINE(GPS_SENTENCE_GPRMC, 7): // Speed (GPRMC)
+#endif
+#if _GPS_HAS_FIELD(_GPS_FIELD_COURSE)
+    case COMBINE(GPS_SENTENCE_GPRMC, 8): // Course (GPRMC)
+#endif
+#if _GPS_HAS_FIELD(_GPS_FIELD_HDOP)
+    case COMBINE(GPS_SENTENCE_GPGGA, 8): // HDOP
+#endif
+#if _GPS_HAS_FIELD(_GPS_FIELD_ALTITUDE)
+    case COMBINE(GPS_SENTENCE_GPGGA, 9): // Altitude (GPGGA)
+#endif
+#if _GPS_HAS_FIELD(_GPS_FIELD_TIME | _GPS_FIELD_SPEED | _GPS_FIELD_COURSE | _GPS_FIELD_HDOP | _GPS_FIELD_ALTITUDE)
+      curTermParser = GPS_TERM_DECIMAL;
+      decimalParser.begin(2);
+      break;
+#endif
+#if _GPS_HAS_FIELD(_GPS_FIELD_DATE)
+    case COMBINE(GPS_SENTENCE_GPRMC, 9): // Date (GPRMC)
+#endif
+#if _GPS_HAS_FIELD(_GPS_FIELD_SATELLITES)
+    case COMBINE(GPS_SENTENCE_GPGGA, 7): // Satellites used (GPGGA)
+#endif
+#if _GPS_HAS_FIELD(_GPS_FIELD_DATE | _GPS_FIELD_SATELLITES)
+      curTermParser = GPS_TERM_DECIMAL;
+      decimalParser.begin(0);
+      break;
+#endif
+#if _GPS_HAS_FIELD(_GPS_FIELD_LOCATION)
+    case COMBINE(GPS_SENTENCE_GPRMC, 3): // Latitude
+    case COMBINE(GPS_SENTENCE_GPGGA, 2):
+    case COMBINE(GPS_SENTENCE_GPRMC, 5): // Longitude
+    case COMBINE(GPS_SENTENCE_GPGGA, 4):
+      curTermParser = GPS_TERM_DEGREES;
+      degreesParser.begin();
+      break;
+    case COMBINE(GPS_SENTENCE_GPRMC, 4): // N/S
+    case COMBINE(GPS_SENTENCE_GPGGA, 3):
+    case COMBINE(GPS_SENTENCE_GPRMC, 6): // E/W
+    case COMBINE(GPS_SENTENCE_GPGGA, 5):
+#endif
+    case COMBINE(GPS_SENTENCE_GPRMC, 2): // GPRMC validity
+    case COMBINE(GPS_SENTENCE_GPGGA, 6): // Fix data (GPGGA)
+      curTermParser = GPS_TERM_COPY;
+      break;
     }
 
-  deg.billionths = (5 * tenMillionthsOfMinutes + 1) / 3;
-  deg.negative = false;
-}
+#if _GPS_PARSE_GSV
+    // Message count and number, satellites in view, then four terms per
+    // satellite: PRN, elevation, azimuth and SNR
+    if (curSentenceType == GPS_SENTENCE_GSV && curTermNumber < 20)
+    {
+      curTermParser = GPS_TERM_DECIMAL;
+      decimalParser.begin(0);
+    }
+#endif
+#if _GPS_PARSE_GSA
+    // PRNs used in the fix, PDOP, HDOP, VDOP and the NMEA 4.1 system id
+    if (curSentenceType == GPS_SENTENCE_GSA && curTermNumber >= 3)
+    {
+      curTermParser = GPS_TERM_DECIMAL;
+      decimalParser.begin(curTermNumber >= 15 && curTermNumber <= 17 ? 2 : 0);
+    }
+#endif
+  }
 
-#define COMBINE(sentence_type, term_number) (((unsigned)(sentence_type) << 5) | term_number)
+  curTermCopied = curTermParser == GPS_TERM_COPY;
+#if _GPS_HAS_FIELD(_GPS_FIELD_CUSTOM)
+  // Custom elements listening to this term still read its text
+  curTermCopied = curTermCopied || (!isChecksumTerm && customListeners(curTermNumber) != NULL);
+#endif
+}
 
 // Processes a just-completed term
 // Returns true if new sentence has just passed checksum test and is validated
@@ -171,30 +296,81 @@ bool TinyGPSPlus::endOfTermHandler()
       switch(curSentenceType)
       {
       case GPS_SENTENCE_GPRMC:
+#if _GPS_HAS_FIELD(_GPS_FIELD_DATE)
         date.commit();
+#endif
+#if _GPS_HAS_FIELD(_GPS_FIELD_TIME)
         time.commit();
+#endif
+#if _GPS_HAS_FIELD(_GPS_FIELD_DATE) && _GPS_HAS_FIELD(_GPS_FIELD_TIME)
+        dateDaySeconds = time.daySeconds();
+#endif
         if (sentenceHasFix)
         {
+#if _GPS_HAS_FIELD(_GPS_FIELD_LOCATION)
            location.commit();
+#endif
+#if _GPS_HAS_FIELD(_GPS_FIELD_SPEED)
            speed.commit();
+#endif
+#if _GPS_HAS_FIELD(_GPS_FIELD_COURSE)
            course.commit();
+#endif
         }
         break;
       case GPS_SENTENCE_GPGGA:
+#if _GPS_HAS_FIELD(_GPS_FIELD_TIME)
         time.commit();
+#endif
         if (sentenceHasFix)
         {
+#if _GPS_HAS_FIELD(_GPS_FIELD_LOCATION)
           location.commit();
+#endif
+#if _GPS_HAS_FIELD(_GPS_FIELD_ALTITUDE)
           altitude.commit();
+#endif
         }
+#if _GPS_HAS_FIELD(_GPS_FIELD_SATELLITES)
         satellites.commit();
+#endif
+#if _GPS_HAS_FIELD(_GPS_FIELD_HDOP)
         hdop.commit();
+#endif
+        break;
+#if _GPS_PARSE_GSV
+      case GPS_SENTENCE_GSV:
+        satelliteTable.commitView(curTermNumber);
         break;
+#endif
+#if _GPS_PARSE_GSA
+      case GPS_SENTENCE_GSA:
+#if _GPS_HAS_FIELD(_GPS_FIELD_DOP)
+        pdop.commit();
+        vdop.commit();
+#endif
+#if _GPS_HAS_FIELD(_GPS_FIELD_SATELLITE_TABLE)
+        satelliteTable.commitUsed();
+#endif
+        break;
+#endif
       }
 
-      // Commit all custom listeners of this sentence type
-      for (TinyGPSCustom *p = customCandidates; p != NULL && strcmp(p->sentenceName, customCandidates->sentenceName) == 0; p = p->next)
-         p->commit();
+#if _GPS_HAS_FIELD(_GPS_FIELD_CUSTOM)
+      commitCustomSentence();
+#endif
+
+      switch(curSentenceType)
+      {
+      case GPS_SENTENCE_GPRMC:
+        notifyFix(TinyGPSFix::DATE | TinyGPSFix::TIME |
+          (sentenceHasFix ? TinyGPSFix::LOCATION | TinyGPSFix::SPEED | TinyGPSFix::COURSE : 0));
+        break;
+      case GPS_SENTENCE_GPGGA:
+        notifyFix(TinyGPSFix::TIME | TinyGPSFix::SATELLITES | TinyGPSFix::HDOP |
+          (sentenceHasFix ? TinyGPSFix::LOCATION | TinyGPSFix::ALTITUDE : 0));
+        break;
+      }
       return true;
     }
 
@@ -209,34 +385,56 @@ bool TinyGPSPlus::endOfTermHandler()
   // the first term determines the sentence type
   if (curTermNumber == 0)
   {
+#if _GPS_HAS_SENTENCE(_GPS_SENTENCE_RMC)
     if (!strcmp(term, _GPRMCterm) || !strcmp(term, _GNRMCterm))
       curSentenceType = GPS_SENTENCE_GPRMC;
-    else if (!strcmp(term, _GPGGAterm) || !strcmp(term, _GNGGAterm))
+    else
+#endif
+#if _GPS_HAS_SENTENCE(_GPS_SENTENCE_GGA)
+    if (!strcmp(term, _GPGGAterm) || !strcmp(term, _GNGGAterm))
       curSentenceType = GPS_SENTENCE_GPGGA;
     else
+#endif
+#if _GPS_PARSE_GSV
+    if (talkerSystems(term) && !strcmp(term + 2, _GSVterm))
+      curSentenceType = GPS_SENTENCE_GSV;
+    else
+#endif
+#if _GPS_PARSE_GSA
+    if (talkerSystems(term) && !strcmp(term + 2, _GSAterm))
+      curSentenceType = GPS_SENTENCE_GSA;
+    else
+#endif
       curSentenceType = GPS_SENTENCE_OTHER;
 
-    // Any custom candidates of this sentence type?
-    for (customCandidates = customElts; customCandidates != NULL && strcmp(customCandidates->sentenceName, term) < 0; customCandidates = customCandidates->next);
-    if (customCandidates != NULL && strcmp(customCandidates->sentenceName, term) > 0)
-       customCandidates = NULL;
+#if _GPS_HAS_FIELD(_GPS_FIELD_SATELLITE_TABLE) && (_GPS_PARSE_GSV || _GPS_PARSE_GSA)
+    if (curSentenceType == GPS_SENTENCE_GSV || curSentenceType == GPS_SENTENCE_GSA)
+      satelliteTable.beginSentence(talkerSystems(term));
+#endif
+
+#if _GPS_HAS_FIELD(_GPS_FIELD_CUSTOM)
+    beginCustomSentence();
+#endif
 
     return false;
   }
 
-  if (curSentenceType != GPS_SENTENCE_OTHER && term[0])
+  if (curSentenceType != GPS_SENTENCE_OTHER && curTermOffset > 0)
     switch(COMBINE(curSentenceType, curTermNumber))
   {
+#if _GPS_HAS_FIELD(_GPS_FIELD_TIME)
     case COMBINE(GPS_SENTENCE_GPRMC, 1): // Time in both sentences
     case COMBINE(GPS_SENTENCE_GPGGA, 1):
-      time.setTime(term);
+      time.setTime(decimalParser.value());
       break;
+#endif
     case COMBINE(GPS_SENTENCE_GPRMC, 2): // GPRMC validity
       sentenceHasFix = term[0] == 'A';
       break;
+#if _GPS_HAS_FIELD(_GPS_FIELD_LOCATION)
     case COMBINE(GPS_SENTENCE_GPRMC, 3): // Latitude
     case COMBINE(GPS_SENTENCE_GPGGA, 2):
-      location.setLatitude(term);
+      location.setLatitude(degreesParser);
       break;
     case COMBINE(GPS_SENTENCE_GPRMC, 4): // N/S
     case COMBINE(GPS_SENTENCE_GPGGA, 3):
@@ -244,43 +442,175 @@ bool TinyGPSPlus::endOfTermHandler()
       break;
     case COMBINE(GPS_SENTENCE_GPRMC, 5): // Longitude
     case COMBINE(GPS_SENTENCE_GPGGA, 4):
-      location.setLongitude(term);
+      location.setLongitude(degreesParser);
       break;
     case COMBINE(GPS_SENTENCE_GPRMC, 6): // E/W
     case COMBINE(GPS_SENTENCE_GPGGA, 5):
       location.rawNewLngData.negative = term[0] == 'W';
       break;
+#endif
+#if _GPS_HAS_FIELD(_GPS_FIELD_SPEED)
     case COMBINE(GPS_SENTENCE_GPRMC, 7): // Speed (GPRMC)
-      speed.set(term);
+      speed.set(decimalParser.value());
       break;
+#endif
+#if _GPS_HAS_FIELD(_GPS_FIELD_COURSE)
     case COMBINE(GPS_SENTENCE_GPRMC, 8): // Course (GPRMC)
-      course.set(term);
+      course.set(decimalParser.value());
       break;
+#endif
+#if _GPS_HAS_FIELD(_GPS_FIELD_DATE)
     case COMBINE(GPS_SENTENCE_GPRMC, 9): // Date (GPRMC)
-      date.setDate(term);
+      date.setDate(decimalParser.value());
       break;
+#endif
     case COMBINE(GPS_SENTENCE_GPGGA, 6): // Fix data (GPGGA)
       sentenceHasFix = term[0] > '0';
       break;
+#if _GPS_HAS_FIELD(_GPS_FIELD_SATELLITES)
     case COMBINE(GPS_SENTENCE_GPGGA, 7): // Satellites used (GPGGA)
-      satellites.set(term);
+      satellites.set(decimalParser.value());
       break;
+#endif
+#if _GPS_HAS_FIELD(_GPS_FIELD_HDOP)
     case COMBINE(GPS_SENTENCE_GPGGA, 8): // HDOP
-      hdop.set(term);
+      hdop.set(decimalParser.value());
       break;
+#endif
+#if _GPS_HAS_FIELD(_GPS_FIELD_ALTITUDE)
     case COMBINE(GPS_SENTENCE_GPGGA, 9): // Altitude (GPGGA)
-      altitude.set(term);
+      altitude.set(decimalParser.value());
       break;
+#endif
+#if _GPS_PARSE_GSA && _GPS_HAS_FIELD(_GPS_FIELD_DOP)
+    case COMBINE(GPS_SENTENCE_GSA, 15): // PDOP (GSA)
+      pdop.set(decimalParser.value());
+      break;
+    case COMBINE(GPS_SENTENCE_GSA, 17): // VDOP (GSA)
+      vdop.set(decimalParser.value());
+      break;
+#endif
+  }
+
+#if _GPS_HAS_FIELD(_GPS_FIELD_SATELLITE_TABLE)
+  if (curTermOffset > 0)
+  {
+#if _GPS_PARSE_GSV
+    if (curSentenceType == GPS_SENTENCE_GSV)
+      satelliteTable.setViewTerm(curTermNumber, decimalParser.value());
+#endif
+#if _GPS_PARSE_GSA
+    if (curSentenceType == GPS_SENTENCE_GSA)
+      satelliteTable.setUsedTerm(curTermNumber, decimalParser.value());
+#endif
   }
+#endif
 
+#if _GPS_HAS_FIELD(_GPS_FIELD_CUSTOM)
   // Set custom values as needed
-  for (TinyGPSCustom *p = customCandidates; p != NULL && strcmp(p->sentenceName, customCandidates->sentenceName) == 0 && p->termNumber <= curTermNumber; p = p->next)
-    if (p->termNumber == curTermNumber)
-         p->set(term);
+  for (TinyGPSCustom *p = customListeners(curTermNumber); p != NULL; p = p->next)
+    p->set(term);
+#endif
 
   return false;
 }
 
+// Takes the snapshot of the committed fields and hands it to the callback
+void TinyGPSPlus::notifyFix(uint8_t updated)
+{
+  if (!fixCallback)
+    return;
+
+  TinyGPSFix fix;
+  fix.updated = updated & _GPS_FIELDS;
+  fix.commitTime = millis();
+
+#if _GPS_HAS_FIELD(_GPS_FIELD_LOCATION)
+  if (location.valid)
+  {
+    fix.valid |= TinyGPSFix::LOCATION;
+    fix.rawLat = location.rawLatData;
+    fix.rawLng = location.rawLngData;
+  }
+#endif
+#if _GPS_HAS_FIELD(_GPS_FIELD_DATE)
+  if (date.valid)
+  {
+    fix.valid |= TinyGPSFix::DATE;
+    fix.date = date.date;
+    fix.yearPart = date.yearPart;
+    fix.monthPart = date.monthPart;
+    fix.dayPart = date.dayPart;
+  }
+#endif
+#if _GPS_HAS_FIELD(_GPS_FIELD_TIME)
+  if (time.valid)
+  {
+    fix.valid |= TinyGPSFix::TIME;
+    fix.time = time.time;
+    fix.hourPart = time.hourPart;
+    fix.minutePart = time.minutePart;
+    fix.secondPart = time.secondPart;
+    fix.centisecondPart = time.centisecondPart;
+  }
+#endif
+#if _GPS_HAS_FIELD(_GPS_FIELD_DATE) && _GPS_HAS_FIELD(_GPS_FIELD_TIME)
+  fix.epoch = epoch();
+#endif
+#if _GPS_HAS_FIELD(_GPS_FIELD_SPEED)
+  if (speed.valid)
+  {
+    fix.valid |= TinyGPSFix::SPEED;
+    fix.speed = speed.val;
+  }
+#endif
+#if _GPS_HAS_FIELD(_GPS_FIELD_COURSE)
+  if (course.valid)
+  {
+    fix.valid |= TinyGPSFix::COURSE;
+    fix.course = course.val;
+  }
+#endif
+#if _GPS_HAS_FIELD(_GPS_FIELD_ALTITUDE)
+  if (altitude.valid)
+  {
+    fix.valid |= TinyGPSFix::ALTITUDE;
+    fix.altitude = altitude.val;
+  }
+#endif
+#if _GPS_HAS_FIELD(_GPS_FIELD_SATELLITES)
+  if (satellites.valid)
+  {
+    fix.valid |= TinyGPSFix::SATELLITES;
+    fix.satellites = satellites.val;
+  }
+#endif
+#if _GPS_HAS_FIELD(_GPS_FIELD_HDOP)
+  if (hdop.valid)
+  {
+    fix.valid |= TinyGPSFix::HDOP;
+    fix.hdop = hdop.val;
+  }
+#endif
+
+  fixCallback(fixCallbackData, fix);
+}
+
+#if _GPS_HAS_FIELD(_GPS_FIELD_DATE) && _GPS_HAS_FIELD(_GPS_FIELD_TIME)
+uint32_t TinyGPSPlus::epoch() const
+{
+  if (!date.valid || !time.valid)
+    return 0;
+
+  uint32_t seconds = time.daySeconds();
+  uint32_t result = date.epochDays * 86400UL + seconds;
+  // A GGA time more than 12 hours before the RMC one is on the next day
+  if (seconds + 43200UL < dateDaySeconds)
+    result += 86400UL;
+  return result;
+}
+#endif
+
 /* static */
 double TinyGPSPlus::distanceBetween(double lat1, double long1, double lat2, double long2)
 {
@@ -342,32 +672,69 @@ void TinyGPSLocation::commit()
    valid = updated = true;
 }
 
-void TinyGPSLocation::setLatitude(const char *term)
+void TinyGPSLocation::setLatitude(const TinyGPSDegreesParser &parser)
 {
-   TinyGPSPlus::parseDegrees(term, rawNewLatData);
+   parser.value(rawNewLatData);
 }
 
-void TinyGPSLocation::setLongitude(const char *term)
+void TinyGPSLocation::setLongitude(const TinyGPSDegreesParser &parser)
 {
-   TinyGPSPlus::parseDegrees(term, rawNewLngData);
+   parser.value(rawNewLngData);
+}
+
+static double toDegrees(const RawDegrees &raw)
+{
+   double ret = raw.deg + raw.billionths / 1000000000.0;
+   return raw.negative ? -ret : ret;
 }
 
 double TinyGPSLocation::lat()
 {
    updated = false;
-   double ret = rawLatData.deg + rawLatData.billionths / 1000000000.0;
-   return rawLatData.negative ? -ret : ret;
+   return toDegrees(rawLatData);
 }
 
 double TinyGPSLocation::lng()
 {
    updated = false;
-   double ret = rawLngData.deg + rawLngData.billionths / 1000000000.0;
-   return rawLngData.negative ? -ret : ret;
+   return toDegrees(rawLngData);
 }
 
+double TinyGPSFix::lat() const
+{
+   return toDegrees(rawLat);
+}
+
+double TinyGPSFix::lng() const
+{
+   return toDegrees(rawLng);
+}
+
+// Days before each month in a non leap year
+static constexpr uint16_t daysBeforeMonth[12] PROGMEM = {
+   0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334
+};
+
 void TinyGPSDate::commit()
 {
+   // The split only changes once a day
+   if (!valid || newDate != date)
+   {
+      dayPart = newDate / 10000;
+      monthPart = (newDate / 100) % 100;
+      yearPart = newDate % 100 + 2000;
+
+      epochDays = 0;
+      if (monthPart >= 1 && monthPart <= 12 && dayPart >= 1)
+      {
+         // Every 4th year from 1972 to 2099 is a leap year
+         epochDays = (yearPart - 1970) * 365U + ((yearPart - 1969) >> 2) +
+            pgm_read_word(&daysBeforeMonth[monthPart - 1]) + dayPart - 1;
+         if (monthPart > 2 && (yearPart & 3) == 0)
+            ++epochDays;
+      }
+   }
+
    date = newDate;
    lastCommitTime = millis();
    valid = updated = true;
@@ -376,87 +743,218 @@ void TinyGPSDate::commit()
 void TinyGPSTime::commit()
 {
    time = newTime;
+   hourPart = time / 1000000;
+   minutePart = (time / 10000) % 100;
+   secondPart = (time / 100) % 100;
+   centisecondPart = time % 100;
    lastCommitTime = millis();
    valid = updated = true;
 }
 
-void TinyGPSTime::setTime(const char *term)
+void TinyGPSTime::setTime(uint32_t value)
 {
-   newTime = (uint32_t)TinyGPSPlus::parseDecimal(term);
+   newTime = value;
 }
 
-void TinyGPSDate::setDate(const char *term)
+void TinyGPSDate::setDate(uint32_t value)
 {
-   newDate = atol(term);
+   newDate = value;
 }
 
-uint16_t TinyGPSDate::year()
+void TinyGPSDecimal::commit()
 {
-   updated = false;
-   uint16_t year = date % 100;
-   return year + 2000;
+   val = newval;
+   lastCommitTime = millis();
+   valid = updated = true;
 }
 
-uint8_t TinyGPSDate::month()
+void TinyGPSDecimal::set(int32_t value)
 {
-   updated = false;
-   return (date / 100) % 100;
+   newval = value;
 }
 
-uint8_t TinyGPSDate::day()
+void TinyGPSInteger::commit()
 {
-   updated = false;
-   return date / 10000;
+   val = newval;
+   lastCommitTime = millis();
+   valid = updated = true;
 }
 
-uint8_t TinyGPSTime::hour()
+void TinyGPSInteger::set(uint32_t value)
 {
-   updated = false;
-   return time / 1000000;
+   newval = value;
 }
 
-uint8_t TinyGPSTime::minute()
+#if _GPS_HAS_FIELD(_GPS_FIELD_SATELLITE_TABLE)
+void TinyGPSSatellites::beginSentence(uint8_t systems)
 {
-   updated = false;
-   return (time / 10000) % 100;
+   sentenceSystems = systems;
+   messageNumber = messageCount = 0;
+   newUsedCount = 0;
+   memset(newPrns, 0, sizeof(newPrns));
+   memset(newElevations, 0, sizeof(newElevations));
+   memset(newAzimuths, 0, sizeof(newAzimuths));
+   memset(newSnrs, 0, sizeof(newSnrs));
 }
 
-uint8_t TinyGPSTime::second()
+void TinyGPSSatellites::setViewTerm(uint8_t termNumber, uint16_t value)
 {
-   updated = false;
-   return (time / 100) % 100;
-}
+   if (termNumber == 1)
+      messageCount = value;
+   else if (termNumber == 2)
+      messageNumber = value;
+   else if (termNumber >= 4)
+   {
+      uint8_t index = (termNumber - 4) / 4;
+      if (index >= GSV_SATELLITES)
+         return;
 
-uint8_t TinyGPSTime::centisecond()
-{
-   updated = false;
-   return time % 100;
+      switch((termNumber - 4) % 4)
+      {
+      case 0:
+         newPrns[index] = value;
+         break;
+      case 1:
+         newElevations[index] = value;
+         break;
+      case 2:
+         newAzimuths[index] = value;
+         break;
+      case 3:
+         newSnrs[index] = value;
+         break;
+      }
+   }
 }
 
-void TinyGPSDecimal::commit()
+// termCount is the number of the checksum term. The NMEA 4.11 signal id
+// that may follow the satellites leaves an incomplete group, which is dropped
+void TinyGPSSatellites::commitView(uint8_t termCount)
 {
-   val = newval;
+   uint8_t received = termCount > 4 ? (termCount - 4) / 4 : 0;
+   if (received > GSV_SATELLITES)
+      received = GSV_SATELLITES;
+
+   if (messageNumber == 1)
+   {
+      // A new cycle replaces the satellites of the talker systems
+      for (uint8_t i = 0; i < satCount; ++i)
+         if (sentenceSystems & (1 << (flags[i] & SYSTEM_MASK)))
+            flags[i] &= ~SEEN;
+      cycleSystems = sentenceSystems;
+      nextMessage = 1;
+   }
+   if (messageNumber != nextMessage)
+      cycleSystems = 0;
+   nextMessage = messageNumber + 1;
+
+   for (uint8_t k = 0; k < received; ++k)
+   {
+      uint16_t prn = newPrns[k];
+      uint8_t system = systemOf(sentenceSystems, prn);
+      if (prn == 0 || prn > 255)
+         continue;
+
+      uint8_t i = find(system, prn);
+      if (i == satCount)
+      {
+         if (satCount == _GPS_MAX_SATELLITES)
+            continue;
+         ++satCount;
+         prns[i] = prn;
+         flags[i] = system;
+      }
+      elevations[i] = newElevations[k];
+      azimuths[i] = newAzimuths[k];
+      snrs[i] = newSnrs[k];
+      flags[i] |= SEEN;
+   }
+
+   // Only a cycle received in full tells which satellites left the view
+   if (messageNumber != messageCount || !cycleSystems)
+      return;
+
+   for (uint8_t i = satCount; i-- > 0;)
+   {
+      if ((cycleSystems & (1 << (flags[i] & SYSTEM_MASK))) && !(flags[i] & SEEN))
+      {
+         --satCount;
+         prns[i] = prns[satCount];
+         elevations[i] = elevations[satCount];
+         azimuths[i] = azimuths[satCount];
+         snrs[i] = snrs[satCount];
+         flags[i] = flags[satCount];
+      }
+   }
+
    lastCommitTime = millis();
    valid = updated = true;
 }
 
-void TinyGPSDecimal::set(const char *term)
+void TinyGPSSatellites::setUsedTerm(uint8_t termNumber, uint16_t value)
 {
-   newval = TinyGPSPlus::parseDecimal(term);
+   if (termNumber >= 3 && termNumber < 3 + GSA_SATELLITES)
+      newPrns[newUsedCount++] = value;
+   else if (termNumber == 18 && value >= 1 && value <= 3)
+      sentenceSystems = 1 << (value - 1); // 1 GPS, 2 GLONASS, 3 Galileo
 }
 
-void TinyGPSInteger::commit()
+// Each GSA sentence lists the satellites of one system used in the fix
+void TinyGPSSatellites::commitUsed()
 {
-   val = newval;
-   lastCommitTime = millis();
-   valid = updated = true;
+   // A GN sentence without system id takes the system of its satellites
+   if (sentenceSystems == ALL_SYSTEMS && newUsedCount == 0)
+      return;
+   uint16_t prn = newPrns[0];
+   uint8_t system = systemOf(sentenceSystems, prn);
+
+   for (uint8_t i = 0; i < satCount; ++i)
+   {
+      if ((flags[i] & SYSTEM_MASK) != system)
+         continue;
+
+      flags[i] &= ~USED;
+      for (uint8_t k = 0; k < newUsedCount; ++k)
+      {
+         prn = newPrns[k];
+         if (systemOf(sentenceSystems, prn) == system && prn == prns[i])
+         {
+            flags[i] |= USED;
+            break;
+         }
+      }
+   }
 }
 
-void TinyGPSInteger::set(const char *term)
+uint8_t TinyGPSSatellites::find(uint8_t system, uint8_t prn) const
 {
-   newval = atol(term);
+   uint8_t i = 0;
+   while (i < satCount && (prns[i] != prn || (flags[i] & SYSTEM_MASK) != system))
+      ++i;
+   return i;
 }
 
+// Returns the system of a satellite and leaves in prn its number within the
+// system. Some receivers number Galileo from 301; GN talkers mix GPS and
+// GLONASS, which uses 65 to 96
+uint8_t TinyGPSSatellites::systemOf(uint8_t systems, uint16_t &prn)
+{
+   if (prn > 300)
+   {
+      prn -= 300;
+      return GALILEO;
+   }
+   if (systems == (1 << GLONASS))
+      return GLONASS;
+   if (systems == (1 << GALILEO))
+      return GALILEO;
+   if (systems == (1 << GPS))
+      return GPS;
+   return prn >= 65 && prn <= 96 ? GLONASS : GPS;
+}
+#endif
+
+#if _GPS_HAS_FIELD(_GPS_FIELD_CUSTOM)
 TinyGPSCustom::TinyGPSCustom(TinyGPSPlus &gps, const char *_sentenceName, int _termNumber)
 {
    begin(gps, _sentenceName, _termNumber);
@@ -466,38 +964,179 @@ void TinyGPSCustom::begin(TinyGPSPlus &gps, const char *_sentenceName, int _term
 {
    lastCommitTime = 0;
    updated = valid = false;
-   sentenceName = _sentenceName;
-   termNumber = _termNumber;
-   memset(stagingBuffer, '\0', sizeof(stagingBuffer));
-   memset(buffer, '\0', sizeof(buffer));
+   current = 0;
+   staged = false;
+   memset(buffers, '\0', sizeof(buffers));
 
-   // Insert this item into the GPS tree
-   gps.insertCustom(this, _sentenceName, _termNumber);
+   // Insert this item into the GPS tables
+   registered = gps.insertCustom(this, _sentenceName, _termNumber);
 }
 
 void TinyGPSCustom::commit()
 {
-   strcpy(this->buffer, this->stagingBuffer);
+   // A term missing from this sentence keeps the previous value
+   if (staged)
+      current ^= 1;
+   staged = false;
    lastCommitTime = millis();
    valid = updated = true;
 }
 
 void TinyGPSCustom::set(const char *term)
 {
-   strncpy(this->stagingBuffer, term, sizeof(this->stagingBuffer));
+   strncpy(buffers[current ^ 1], term, _GPS_MAX_FIELD_SIZE);
+   staged = true;
+}
+
+// Returns false if the sentence name or the term number does not fit
+bool TinyGPSPlus::insertCustom(TinyGPSCustom *pElt, const char *sentenceName, int termNumber)
+{
+   uint8_t sentence = 0;
+   while (sentence < customSentenceCount && strcmp(customSentences[sentence], sentenceName))
+      ++sentence;
+
+   if (sentence == _GPS_MAX_CUSTOM_SENTENCES || termNumber < 1 || termNumber >= _GPS_MAX_CUSTOM_TERMS)
+      return false;
+
+   if (sentence == customSentenceCount)
+      customSentences[customSentenceCount++] = sentenceName;
+
+   pElt->next = customTerms[sentence][termNumber];
+   customTerms[sentence][termNumber] = pElt;
+   return true;
+}
+
+// Elements listening to a term of the current sentence, NULL if none
+TinyGPSCustom *TinyGPSPlus::customListeners(uint8_t termNumber) const
+{
+   if (curCustomSentence < 0 || termNumber >= _GPS_MAX_CUSTOM_TERMS)
+      return NULL;
+   return customTerms[curCustomSentence][termNumber];
+}
+
+// Looks up the sentence name held in term and discards the values staged
+// by a previous sentence of the same name that failed its checksum
+void TinyGPSPlus::beginCustomSentence()
+{
+   curCustomSentence = -1;
+   for (uint8_t i = 0; i < customSentenceCount; ++i)
+      if (!strcmp(customSentences[i], term))
+      {
+         curCustomSentence = i;
+         break;
+      }
+
+   for (uint8_t i = 1; i < _GPS_MAX_CUSTOM_TERMS; ++i)
+      for (TinyGPSCustom *p = customListeners(i); p != NULL; p = p->next)
+         p->staged = false;
+}
+
+void TinyGPSPlus::commitCustomSentence()
+{
+   for (uint8_t i = 1; i < _GPS_MAX_CUSTOM_TERMS; ++i)
+      for (TinyGPSCustom *p = customListeners(i); p != NULL; p = p->next)
+         p->commit();
+}
+#endif
+
+static const int32_t powersOfTen[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000};
+// Largest whole part that fits in int32_t scaled by each power of ten
+static const int32_t maxWholes[] = {INT32_MAX, 214748364, 21474836, 2147483, 214748, 21474, 2147, 214};
+
+void TinyGPSDecimalParser::begin(uint8_t decimals)
+{
+   state = SIGN;
+   this->decimals = decimals < 8 ? decimals : 7;
+   fractionDigits = 0;
+   negative = false;
+   whole = fraction = 0;
 }
 
-void TinyGPSPlus::insertCustom(TinyGPSCustom *pElt, const char *sentenceName, int termNumber)
+void TinyGPSDecimalParser::feed(char c)
 {
-   TinyGPSCustom **ppelt;
+   bool isDigit = c >= '0' && c <= '9';
 
-   for (ppelt = &this->customElts; *ppelt != NULL; ppelt = &(*ppelt)->next)
+   switch (state)
    {
-      int cmp = strcmp(sentenceName, (*ppelt)->sentenceName);
-      if (cmp < 0 || (cmp == 0 && termNumber < (*ppelt)->termNumber))
+   case SIGN:
+      state = WHOLE;
+      if (c == '-')
+      {
+         negative = true;
          break;
+      }
+      // fall through
+   case WHOLE:
+      if (!isDigit)
+         state = c == '.' ? FRACTION : DONE;
+      else if (whole < maxWholes[1] || (whole == maxWholes[1] && c <= '7'))
+         whole = 10 * whole + (c - '0');
+      else
+         // Saturates, value() clamps it
+         whole = INT32_MAX;
+      break;
+   case FRACTION:
+      if (!isDigit)
+         state = DONE;
+      else if (fractionDigits < decimals)
+      {
+         fraction = 10 * fraction + (c - '0');
+         ++fractionDigits;
+      }
+      break;
    }
+}
 
-   pElt->next = *ppelt;
-   *ppelt = pElt;
+int32_t TinyGPSDecimalParser::value() const
+{
+   // Below 2^32 as long as whole fits, which is checked first
+   uint32_t ret = (uint32_t)whole * powersOfTen[decimals] + fraction * powersOfTen[decimals - fractionDigits];
+   if (whole > maxWholes[decimals] || ret > INT32_MAX)
+      ret = INT32_MAX;
+   return negative ? -(int32_t)ret : (int32_t)ret;
+}
+
+void TinyGPSDegreesParser::begin()
+{
+   state = WHOLE;
+   degrees = 0;
+   minutesTens = minutesUnits = 0;
+   fractionDigits = 0;
+   tenMillionthsOfMinutes = 0;
+}
+
+void TinyGPSDegreesParser::feed(char c)
+{
+   bool isDigit = c >= '0' && c <= '9';
+
+   switch (state)
+   {
+   case WHOLE:
+      if (isDigit)
+      {
+         // Shift the digits left: the last two are always the minutes
+         degrees = 10 * degrees + minutesTens;
+         minutesTens = minutesUnits;
+         minutesUnits = c - '0';
+      }
+      else
+         state = c == '.' ? FRACTION : DONE;
+      break;
+   case FRACTION:
+      if (!isDigit)
+         state = DONE;
+      else if (fractionDigits < 7)
+         // First digit is worth 10^6 ten millionths of minute, the 8th and
+         // later digits are below the resolution
+         tenMillionthsOfMinutes += (c - '0') * powersOfTen[6 - fractionDigits++];
+      break;
+   }
+}
+
+void TinyGPSDegreesParser::value(RawDegrees &deg) const
+{
+   uint32_t minutes = (10 * minutesTens + minutesUnits) * 10000000UL + tenMillionthsOfMinutes;
+   deg.deg = degrees;
+   deg.billionths = (5 * minutes + 1) / 3;
+   deg.negative = false;
 }
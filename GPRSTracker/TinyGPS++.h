@@ -40,6 +40,69 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #define _GPS_FEET_PER_METER 3.2808399
 #define _GPS_MAX_FIELD_SIZE 15
 
+// Fields decoded by TinyGPSPlus. Set _GPS_FIELDS in TinyGPS++Config.h to
+// leave out the members and the parsing code of the fields that are not
+// used. The bits match the TinyGPSFix field mask
+#define _GPS_FIELD_LOCATION   0x01
+#define _GPS_FIELD_DATE       0x02
+#define _GPS_FIELD_TIME       0x04
+#define _GPS_FIELD_SPEED      0x08
+#define _GPS_FIELD_COURSE     0x10
+#define _GPS_FIELD_ALTITUDE   0x20
+#define _GPS_FIELD_SATELLITES 0x40
+#define _GPS_FIELD_HDOP       0x80
+#define _GPS_FIELD_CUSTOM     0x100
+// The satellite table and the PDOP and VDOP values are opt-in, they are
+// left out unless _GPS_FIELDS has them
+#define _GPS_FIELD_SATELLITE_TABLE 0x200
+#define _GPS_FIELD_DOP        0x400
+#define _GPS_HAS_FIELD(f) ((_GPS_FIELDS & (f)) != 0)
+
+// Sentences recognized by TinyGPSPlus, the other ones are only checksummed
+// and handed to the custom elements. GSV and GSA are opt-in like the
+// fields they feed
+#define _GPS_SENTENCE_RMC 0x1
+#define _GPS_SENTENCE_GGA 0x2
+#define _GPS_SENTENCE_GSV 0x4
+#define _GPS_SENTENCE_GSA 0x8
+
+// The sketch sets the masks and table sizes in its own header, included
+// by the sketch and the library alike. -D flags are not used, the Arduino
+// IDE has no way to pass them
+#include "TinyGPS++Config.h"
+
+#ifndef _GPS_FIELDS
+#define _GPS_FIELDS 0x1FF
+#endif
+#ifndef _GPS_SENTENCES
+#define _GPS_SENTENCES 0x3
+#endif
+
+// Custom elements are indexed by sentence and term: up to
+// _GPS_MAX_CUSTOM_SENTENCES sentence names, listening to terms 1 to
+// _GPS_MAX_CUSTOM_TERMS - 1. Elements beyond these limits are not
+// registered, see TinyGPSCustom::isRegistered(). The table is always
+// allocated, each sentence name costs _GPS_MAX_CUSTOM_TERMS pointers of
+// RAM, so the defaults are small and TinyGPS++Config.h raises them
+#ifndef _GPS_MAX_CUSTOM_SENTENCES
+#define _GPS_MAX_CUSTOM_SENTENCES 1
+#endif
+#ifndef _GPS_MAX_CUSTOM_TERMS
+#define _GPS_MAX_CUSTOM_TERMS 3
+#endif
+
+// Size of the satellite table filled from GSV and GSA sentences
+#ifndef _GPS_MAX_SATELLITES
+#define _GPS_MAX_SATELLITES 16
+#endif
+#define _GPS_HAS_SENTENCE(s) ((_GPS_SENTENCES & (s)) != 0)
+
+// GSV feeds the satellite table, GSA the used flags and the DOP values.
+// Each is parsed only if the build has both the sentence and a field it
+// feeds
+#define _GPS_PARSE_GSV (_GPS_HAS_SENTENCE(_GPS_SENTENCE_GSV) && _GPS_HAS_FIELD(_GPS_FIELD_SATELLITE_TABLE))
+#define _GPS_PARSE_GSA (_GPS_HAS_SENTENCE(_GPS_SENTENCE_GSA) && _GPS_HAS_FIELD(_GPS_FIELD_SATELLITE_TABLE | _GPS_FIELD_DOP))
+
 struct RawDegrees
 {
    uint16_t deg;
@@ -50,6 +113,49 @@ public:
    {}
 };
 
+// Single pass, locale free parser of a (potentially negative) decimal
+// number -xxxx.yyy, fed one character at a time as the term is received.
+// Keeps "decimals" digits of the fraction, up to 7, the value is scaled by
+// 10^decimals. Values that do not fit in int32_t are clamped to INT32_MAX
+// or -INT32_MAX, with 7 decimals that is from a whole part of about 215
+struct TinyGPSDecimalParser
+{
+public:
+   void begin(uint8_t decimals = 2);
+   void feed(char c);
+   int32_t value() const;
+
+   TinyGPSDecimalParser() { begin(); }
+
+private:
+   enum {SIGN, WHOLE, FRACTION, DONE};
+   uint8_t state;
+   uint8_t decimals, fractionDigits;
+   bool negative;
+   int32_t whole, fraction;
+};
+
+// Single pass parser of degrees in the NMEA format DDMM.MMMM, fed one
+// character at a time
+struct TinyGPSDegreesParser
+{
+public:
+   void begin();
+   void feed(char c);
+   void value(RawDegrees &deg) const;
+
+   TinyGPSDegreesParser() { begin(); }
+
+private:
+   enum {WHOLE, FRACTION, DONE};
+   uint8_t state;
+   // Digits left of the two minute digits, then the two minute digits
+   uint16_t degrees;
+   uint8_t minutesTens, minutesUnits;
+   uint8_t fractionDigits;
+   uint32_t tenMillionthsOfMinutes;
+};
+
 struct TinyGPSLocation
 {
    friend class TinyGPSPlus;
@@ -70,8 +176,8 @@ private:
    RawDegrees rawLatData, rawLngData, rawNewLatData, rawNewLngData;
    uint32_t lastCommitTime;
    void commit();
-   void setLatitude(const char *term);
-   void setLongitude(const char *term);
+   void setLatitude(const TinyGPSDegreesParser &parser);
+   void setLongitude(const TinyGPSDegreesParser &parser);
 };
 
 struct TinyGPSDate
@@ -83,19 +189,26 @@ public:
    uint32_t age() const       { return valid ? millis() - lastCommitTime : (uint32_t)ULONG_MAX; }
 
    uint32_t value()           { updated = false; return date; }
-   uint16_t year();
-   uint8_t month();
-   uint8_t day();
-
-   TinyGPSDate() : valid(false), updated(false), date(0)
+   uint16_t year()            { updated = false; return yearPart; }
+   uint8_t month()            { updated = false; return monthPart; }
+   uint8_t day()              { updated = false; return dayPart; }
+   // Seconds since 1970-01-01 UTC at the start of the date, valid until 2099
+   uint32_t epoch()           { updated = false; return epochDays * 86400UL; }
+
+   TinyGPSDate() : valid(false), updated(false), date(0), yearPart(2000), monthPart(0),
+      dayPart(0), epochDays(0)
    {}
 
 private:
    bool valid, updated;
    uint32_t date, newDate;
    uint32_t lastCommitTime;
+   // date split when it is committed
+   uint16_t yearPart;
+   uint8_t monthPart, dayPart;
+   uint16_t epochDays;
    void commit();
-   void setDate(const char *term);
+   void setDate(uint32_t value);
 };
 
 struct TinyGPSTime
@@ -107,20 +220,25 @@ public:
    uint32_t age() const       { return valid ? millis() - lastCommitTime : (uint32_t)ULONG_MAX; }
 
    uint32_t value()           { updated = false; return time; }
-   uint8_t hour();
-   uint8_t minute();
-   uint8_t second();
-   uint8_t centisecond();
-
-   TinyGPSTime() : valid(false), updated(false), time(0)
+   uint8_t hour()             { updated = false; return hourPart; }
+   uint8_t minute()           { updated = false; return minutePart; }
+   uint8_t second()           { updated = false; return secondPart; }
+   uint8_t centisecond()      { updated = false; return centisecondPart; }
+   uint32_t secondsOfDay()    { updated = false; return daySeconds(); }
+
+   TinyGPSTime() : valid(false), updated(false), time(0), hourPart(0), minutePart(0),
+      secondPart(0), centisecondPart(0)
    {}
 
 private:
    bool valid, updated;
    uint32_t time, newTime;
    uint32_t lastCommitTime;
+   // time split when it is committed
+   uint8_t hourPart, minutePart, secondPart, centisecondPart;
+   uint32_t daySeconds() const { return hourPart * 3600UL + minutePart * 60U + secondPart; }
    void commit();
-   void setTime(const char *term);
+   void setTime(uint32_t value);
 };
 
 struct TinyGPSDecimal
@@ -140,7 +258,7 @@ private:
    uint32_t lastCommitTime;
    int32_t val, newval;
    void commit();
-   void set(const char *term);
+   void set(int32_t value);
 };
 
 struct TinyGPSInteger
@@ -160,7 +278,7 @@ private:
    uint32_t lastCommitTime;
    uint32_t val, newval;
    void commit();
-   void set(const char *term);
+   void set(uint32_t value);
 };
 
 struct TinyGPSSpeed : TinyGPSDecimal
@@ -184,48 +302,196 @@ struct TinyGPSAltitude : TinyGPSDecimal
    double feet()         { return _GPS_FEET_PER_METER * value() / 100.0; }
 };
 
+// Satellites in view reported by GSV sentences, flagged with the ones used
+// in the fix by GSA sentences, for the GP, GL, GA and GN talkers. Each
+// attribute is kept in its own array indexed from 0 to count() - 1. The
+// satellites of a constellation are replaced when its GSV cycle completes;
+// satellites that do not fit in _GPS_MAX_SATELLITES are left out
+struct TinyGPSSatellites
+{
+   friend class TinyGPSPlus;
+public:
+   enum System { GPS, GLONASS, GALILEO };
+
+   bool isValid() const    { return valid; }
+   bool isUpdated() const  { return updated; }
+   uint32_t age() const    { return valid ? millis() - lastCommitTime : (uint32_t)ULONG_MAX; }
+   uint8_t count()         { updated = false; return satCount; }
+
+   uint8_t prn(uint8_t i) const        { return prns[i]; }
+   System system(uint8_t i) const      { return (System)(flags[i] & SYSTEM_MASK); }
+   uint8_t elevation(uint8_t i) const  { return elevations[i]; }  // degrees
+   uint16_t azimuth(uint8_t i) const   { return azimuths[i]; }    // degrees
+   uint8_t snr(uint8_t i) const        { return snrs[i]; }        // dB-Hz, 0 if not tracked
+   bool isUsed(uint8_t i) const        { return flags[i] & USED; }
+
+   TinyGPSSatellites() : valid(false), updated(false), satCount(0), cycleSystems(0),
+      nextMessage(0)
+   {}
+
+private:
+   enum { SYSTEM_MASK = 0x03, USED = 0x04, SEEN = 0x08 };
+   enum { ALL_SYSTEMS = (1 << GPS) | (1 << GLONASS) | (1 << GALILEO) };
+   enum { GSV_SATELLITES = 4, GSA_SATELLITES = 12 };
+
+   bool valid, updated;
+   uint32_t lastCommitTime;
+   uint8_t satCount;
+   uint8_t prns[_GPS_MAX_SATELLITES];
+   uint8_t elevations[_GPS_MAX_SATELLITES];
+   uint16_t azimuths[_GPS_MAX_SATELLITES];
+   uint8_t snrs[_GPS_MAX_SATELLITES];
+   uint8_t flags[_GPS_MAX_SATELLITES];   // system, USED and SEEN
+
+   // Sentence being received. sentenceSystems is a mask of the systems the
+   // talker can report; cycleSystems is cleared when a GSV message is lost
+   uint8_t sentenceSystems, cycleSystems;
+   uint8_t nextMessage, messageNumber, messageCount;
+   uint16_t newPrns[GSA_SATELLITES];
+   uint8_t newElevations[GSV_SATELLITES];
+   uint16_t newAzimuths[GSV_SATELLITES];
+   uint8_t newSnrs[GSV_SATELLITES];
+   uint8_t newUsedCount;
+
+   void beginSentence(uint8_t systems);
+   void setViewTerm(uint8_t termNumber, uint16_t value);
+   void commitView(uint8_t termCount);
+   void setUsedTerm(uint8_t termNumber, uint16_t value);
+   void commitUsed();
+   uint8_t find(uint8_t system, uint8_t prn) const;
+   static uint8_t systemOf(uint8_t systems, uint16_t &prn);
+};
+
+// Immutable copy of all the fields, taken when a validated RMC or GGA
+// sentence is committed. Fields keep the units of the TinyGPS++ objects
+struct TinyGPSFix
+{
+   enum Field
+   {
+      LOCATION = 0x01, DATE = 0x02, TIME = 0x04, SPEED = 0x08,
+      COURSE = 0x10, ALTITUDE = 0x20, SATELLITES = 0x40, HDOP = 0x80
+   };
+
+   uint8_t valid;       // fields that hold data
+   uint8_t updated;     // fields set by the sentence just committed
+   uint32_t commitTime; // millis() of the commit
+   RawDegrees rawLat, rawLng;
+   uint32_t date;       // DDMMYY
+   uint32_t time;       // HHMMSScc
+   uint32_t epoch;      // seconds since 1970-01-01 UTC, if DATE and TIME are valid
+   int32_t speed;       // knots * 100
+   int32_t course;      // degrees * 100
+   int32_t altitude;    // meters * 100
+   uint32_t satellites;
+   int32_t hdop;        // * 100
+
+   // date and time split, copied from TinyGPSDate and TinyGPSTime
+   uint16_t yearPart;
+   uint8_t monthPart, dayPart;
+   uint8_t hourPart, minutePart, secondPart, centisecondPart;
+
+   bool isValid(uint8_t fields) const   { return (valid & fields) == fields; }
+   bool isUpdated(uint8_t fields) const { return (updated & fields) == fields; }
+   double lat() const;
+   double lng() const;
+   uint16_t year() const                { return yearPart; }
+   uint8_t month() const                { return monthPart; }
+   uint8_t day() const                  { return dayPart; }
+   uint8_t hour() const                 { return hourPart; }
+   uint8_t minute() const               { return minutePart; }
+   uint8_t second() const               { return secondPart; }
+   uint8_t centisecond() const          { return centisecondPart; }
+
+   TinyGPSFix() : valid(0), updated(0), commitTime(0), date(0), time(0), epoch(0), speed(0),
+      course(0), altitude(0), satellites(0), hdop(0), yearPart(2000), monthPart(0), dayPart(0),
+      hourPart(0), minutePart(0), secondPart(0), centisecondPart(0)
+   {}
+};
+
+#if _GPS_HAS_FIELD(_GPS_FIELD_CUSTOM)
 class TinyGPSPlus;
 class TinyGPSCustom
 {
 public:
-   TinyGPSCustom() {};
+   TinyGPSCustom() : registered(false) {};
    TinyGPSCustom(TinyGPSPlus &gps, const char *sentenceName, int termNumber);
    void begin(TinyGPSPlus &gps, const char *_sentenceName, int _termNumber);
 
    bool isUpdated() const  { return updated; }
    bool isValid() const    { return valid; }
+   // False if the sentence or term did not fit the tables, the element is
+   // then never updated
+   bool isRegistered() const { return registered; }
    uint32_t age() const    { return valid ? millis() - lastCommitTime : (uint32_t)ULONG_MAX; }
-   const char *value()     { updated = false; return buffer; }
+   const char *value()     { updated = false; return buffers[current]; }
 
 private:
    void commit();
    void set(const char *term);
 
-   char stagingBuffer[_GPS_MAX_FIELD_SIZE + 1];
-   char buffer[_GPS_MAX_FIELD_SIZE + 1];
+   // The committed value and the one being received; commit swaps them
+   char buffers[2][_GPS_MAX_FIELD_SIZE + 1];
+   uint8_t current;
+   bool staged;
    unsigned long lastCommitTime;
-   bool valid, updated;
-   const char *sentenceName;
-   int termNumber;
+   bool valid, updated, registered;
    friend class TinyGPSPlus;
-   TinyGPSCustom *next;
+   TinyGPSCustom *next; // next element listening to the same term
 };
+#endif
 
 class TinyGPSPlus
 {
 public:
+  typedef void (*FixCallback)(void *data, const TinyGPSFix &fix);
+
   TinyGPSPlus();
   bool encode(char c); // process one character received from GPS
   TinyGPSPlus &operator << (char c) {encode(c); return *this;}
 
+  // callback is called with a snapshot of all the fields each time a
+  // validated RMC or GGA sentence is committed. Reading the snapshot does
+  // not clear the updated flags of the fields
+  void onFix(FixCallback callback, void *data) { fixCallback = callback; fixCallbackData = data; }
+
+#if _GPS_HAS_FIELD(_GPS_FIELD_LOCATION)
   TinyGPSLocation location;
+#endif
+#if _GPS_HAS_FIELD(_GPS_FIELD_DATE)
   TinyGPSDate date;
+#endif
+#if _GPS_HAS_FIELD(_GPS_FIELD_TIME)
   TinyGPSTime time;
+#endif
+#if _GPS_HAS_FIELD(_GPS_FIELD_SPEED)
   TinyGPSSpeed speed;
+#endif
+#if _GPS_HAS_FIELD(_GPS_FIELD_COURSE)
   TinyGPSCourse course;
+#endif
+#if _GPS_HAS_FIELD(_GPS_FIELD_ALTITUDE)
   TinyGPSAltitude altitude;
+#endif
+#if _GPS_HAS_FIELD(_GPS_FIELD_SATELLITES)
   TinyGPSInteger satellites;
+#endif
+#if _GPS_HAS_FIELD(_GPS_FIELD_HDOP)
   TinyGPSDecimal hdop;
+#endif
+#if _GPS_HAS_FIELD(_GPS_FIELD_DOP)
+  TinyGPSDecimal pdop;
+  TinyGPSDecimal vdop;
+#endif
+#if _GPS_HAS_FIELD(_GPS_FIELD_SATELLITE_TABLE)
+  TinyGPSSatellites satelliteTable;
+#endif
+
+#if _GPS_HAS_FIELD(_GPS_FIELD_DATE) && _GPS_HAS_FIELD(_GPS_FIELD_TIME)
+  // Seconds since 1970-01-01 UTC of the last committed time, 0 until both
+  // date and time are valid. Accounts for GGA sentences past midnight that
+  // arrive before the RMC with the new date. Does not clear updated flags
+  uint32_t epoch() const;
+#endif
 
   static const char *libraryVersion() { return _GPS_VERSION; }
 
@@ -233,7 +499,7 @@ public:
   static double courseTo(double lat1, double long1, double lat2, double long2);
   static const char *cardinal(double course);
 
-  static int32_t parseDecimal(const char *term);
+  static int32_t parseDecimal(const char *term, uint8_t decimals = 2);
   static void parseDegrees(const char *term, RawDegrees &deg);
 
   uint32_t charsProcessed()   const { return encodedCharCount; }
@@ -242,7 +508,12 @@ public:
   uint32_t passedChecksum()   const { return passedChecksumCount; }
 
 private:
-  enum {GPS_SENTENCE_GPGGA, GPS_SENTENCE_GPRMC, GPS_SENTENCE_OTHER};
+  enum {GPS_SENTENCE_GPGGA, GPS_SENTENCE_GPRMC, GPS_SENTENCE_GSV, GPS_SENTENCE_GSA, GPS_SENTENCE_OTHER};
+
+  // How the characters of the current term are processed. Numeric fields
+  // are accumulated while they are received, flags and unknown terms are
+  // copied and disabled fields are skipped
+  enum {GPS_TERM_COPY, GPS_TERM_DECIMAL, GPS_TERM_DEGREES, GPS_TERM_SKIP};
 
   // parsing state variables
   uint8_t parity;
@@ -251,13 +522,34 @@ private:
   uint8_t curSentenceType;
   uint8_t curTermNumber;
   uint8_t curTermOffset;
+  uint8_t curTermParser;
+  bool curTermCopied;
   bool sentenceHasFix;
+  TinyGPSDecimalParser decimalParser;
+  TinyGPSDegreesParser degreesParser;
 
+#if _GPS_HAS_FIELD(_GPS_FIELD_CUSTOM)
   // custom element support
   friend class TinyGPSCustom;
-  TinyGPSCustom *customElts;
-  TinyGPSCustom *customCandidates;
-  void insertCustom(TinyGPSCustom *pElt, const char *sentenceName, int index);
+  const char *customSentences[_GPS_MAX_CUSTOM_SENTENCES];
+  TinyGPSCustom *customTerms[_GPS_MAX_CUSTOM_SENTENCES][_GPS_MAX_CUSTOM_TERMS];
+  uint8_t customSentenceCount;
+  int8_t curCustomSentence; // index in customSentences, -1 if none
+  bool insertCustom(TinyGPSCustom *pElt, const char *sentenceName, int index);
+  TinyGPSCustom *customListeners(uint8_t termNumber) const;
+  void beginCustomSentence();
+  void commitCustomSentence();
+#endif
+
+#if _GPS_HAS_FIELD(_GPS_FIELD_DATE) && _GPS_HAS_FIELD(_GPS_FIELD_TIME)
+  // Seconds of day of the time received with the date
+  uint32_t dateDaySeconds;
+#endif
+
+  // sentence complete callback
+  FixCallback fixCallback;
+  void *fixCallbackData;
+  void notifyFix(uint8_t updated);
 
   // statistics
   uint32_t encodedCharCount;
@@ -267,6 +559,7 @@ private:
 
   // internal utilities
   int fromHex(char a);
+  void beginTerm();
   bool endOfTermHandler();
 };
 
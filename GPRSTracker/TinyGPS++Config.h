@@ -0,0 +1,23 @@
+// TinyGPS++Config.h
+//
+// Build options of TinyGPSPlus for this sketch. TinyGPS++.h includes this
+// file, so the sketch and TinyGPS++.cpp, which the Arduino IDE compiles
+// separately, always see the same class layout. A #define in the sketch
+// before including TinyGPS++.h would not reach TinyGPS++.cpp
+
+#ifndef _TINYGPSPLUSCONFIG_h
+#define _TINYGPSPLUSCONFIG_h
+
+// The fields the tracker reads. GPSConfig needs the custom elements
+#define _GPS_FIELDS (_GPS_FIELD_LOCATION | _GPS_FIELD_DATE | _GPS_FIELD_TIME | \
+	_GPS_FIELD_SPEED | _GPS_FIELD_COURSE | _GPS_FIELD_ALTITUDE | \
+	_GPS_FIELD_SATELLITES | _GPS_FIELD_HDOP | _GPS_FIELD_CUSTOM)
+
+// GPSConfig configures the receiver to send only these two
+#define _GPS_SENTENCES (_GPS_SENTENCE_RMC | _GPS_SENTENCE_GGA)
+
+// The only custom elements are the PMTK001 terms 1 and 2 GPSConfig reads
+#define _GPS_MAX_CUSTOM_SENTENCES 1
+#define _GPS_MAX_CUSTOM_TERMS 3
+
+#endif
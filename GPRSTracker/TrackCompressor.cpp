@@ -0,0 +1,81 @@
+// 
+// 
+// 
+
+#include "TrackCompressor.h"
+#include "GeoMath.h"
+
+TrackCompressor::TrackCompressor(unsigned int tolerance, unsigned long maxInterval) :
+	tolerance(tolerance),
+	maxInterval(maxInterval),
+	hasAnchor(false),
+	anchorLat(0),
+	anchorLng(0),
+	anchorCosLat(0),
+	anchorTime(0),
+	velocityNorth(0),
+	velocityEast(0)
+{
+}
+
+bool TrackCompressor::isKeyPoint(const TinyGPSFix &fix)
+{
+	if (!hasAnchor)
+	{
+		return true;
+	}
+
+	unsigned long elapsed = fix.commitTime - anchorTime;
+	if (elapsed > maxInterval)
+	{
+		return true;
+	}
+
+	int16_t north, east;
+	if (!GeoMath::localOffset(
+		anchorLat, anchorLng,
+		GeoMath::toE7(fix.rawLat), GeoMath::toE7(fix.rawLng),
+		anchorCosLat, north, east))
+	{
+		return true;
+	}
+
+	// cm/s times deciseconds gives millimeters, so divide by 1000
+	int32_t deciseconds = elapsed / 100;
+	int32_t errorNorth = north - velocityNorth * deciseconds / 1000;
+	int32_t errorEast = east - velocityEast * deciseconds / 1000;
+
+	// Cheap test first, it also keeps the squares below from overflowing
+	if (abs(errorNorth) > (int32_t)tolerance || abs(errorEast) > (int32_t)tolerance)
+	{
+		return true;
+	}
+
+	uint32_t squaredError = (uint32_t)(errorNorth * errorNorth) + (uint32_t)(errorEast * errorEast);
+	return squaredError > (uint32_t)tolerance * tolerance;
+}
+
+void TrackCompressor::reported(const TinyGPSFix &fix)
+{
+	if (!fix.isValid(TinyGPSFix::LOCATION))
+	{
+		hasAnchor = false;
+		return;
+	}
+
+	anchorLat = GeoMath::toE7(fix.rawLat);
+	anchorLng = GeoMath::toE7(fix.rawLng);
+	anchorCosLat = GeoMath::cosLatQ15(anchorLat);
+	anchorTime = fix.commitTime;
+	hasAnchor = true;
+
+	velocityNorth = velocityEast = 0;
+	if (fix.isValid(TinyGPSFix::SPEED | TinyGPSFix::COURSE))
+	{
+		// Knots * 100 to cm/s
+		int32_t speed = fix.speed * 33715L / 65536L;
+		double course = radians(fix.course / 100.0);
+		velocityNorth = speed * cos(course);
+		velocityEast = speed * sin(course);
+	}
+}
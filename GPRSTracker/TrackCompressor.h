@@ -0,0 +1,58 @@
+// TrackCompressor.h
+
+#ifndef _TRACKCOMPRESSOR_h
+#define _TRACKCOMPRESSOR_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+	#include "Arduino.h"
+#else
+	#include "WProgram.h"
+#endif
+
+#include "TinyGPS++.h"
+
+/**
+ * Dead reckoning compressor for the fix stream. From the last reported fix
+ * and its speed and course it predicts where the vehicle should be now.
+ * Fixes that are within tolerance meters of the prediction add no
+ * information and are not transmitted. Uses constant memory and only
+ * integer math for each fix; trigonometry runs once per reported fix.
+ */
+class TrackCompressor
+{
+ public:
+	/**
+	 * tolerance is the allowed error in meters. After maxInterval
+	 * milliseconds the prediction is not trusted anymore
+	 */
+	TrackCompressor(unsigned int tolerance, unsigned long maxInterval);
+
+	/**
+	 * Returns true if fix deviates from the prediction, so it must be
+	 * transmitted
+	 */
+	bool isKeyPoint(const TinyGPSFix &fix);
+
+	/**
+	 * Takes fix as the base of the next predictions
+	 */
+	void reported(const TinyGPSFix &fix);
+
+ private:
+	unsigned int tolerance;
+	unsigned long maxInterval;
+
+	// Base of the prediction
+	bool hasAnchor;
+	int32_t anchorLat;
+	int32_t anchorLng;
+	uint16_t anchorCosLat;
+	unsigned long anchorTime;
+
+	// Velocity at the anchor in cm/s
+	int16_t velocityNorth;
+	int16_t velocityEast;
+};
+
+#endif
+
@@ -3,6 +3,18 @@
 #include <string.h> //Used for string manipulations
 #include "GPRS.h"
 #include "TinyGPS++.h"
+#include "ReportPolicy.h"
+#include "TrackCompressor.h"
+#include "GeoMath.h"
+#include "FixCodec.h"
+#include "Geofence.h"
+#include "FixFilter.h"
+#include "KalmanSmoother.h"
+#include "GPSConfig.h"
+#include "PersistentState.h"
+#include "FixStore.h"
+#include "PowerManager.h"
+#include "Recovery.h"
 
 // The serial connection to the GPS device
 SoftwareSerial gpsSerial(7,8);
@@ -11,14 +23,43 @@ SoftwareSerial cellSerial(2, 3);
 // Triggers passage to DEAD Status
 const unsigned char DEADCHAR = 255;
 
-// GRPS Object
-GPRS gprs(cellSerial, "antel.lte", "", "", "200.40.220.245");
+// GRPS Object, a public DNS is asked if the operator one does not answer
+GPRS gprs(cellSerial, "antel.lte", "", "", "200.40.220.245", "8.8.8.8");
+// Raised from 9600 once the modem is ready, the +SDATA hex dumps double
+// the bytes of each answer
+const long MODEM_BAUD_RATE = 19200;
 // The TinyGPS++ object
 TinyGPSPlus gps;
-// The request path to make requests
-String requestPath;
+// Switches the receiver to 19200 baud, RMC and GGA only and 5 fixes per
+// second. With only two sentences 19200 baud is enough for 5 Hz
+GPSConfig gpsConfig(gpsSerial, gps, 19200, 200);
+// Snapshot of the last fix accepted by fixFilter
+TinyGPSFix lastFix;
+// Set by the fix callback when lastFix has to be uploaded
+bool fixReady = false;
+// Encodes uploaded fixes as deltas from the last acknowledged one
+FixEncoder fixEncoder;
+// Fixes waiting to be uploaded, in 640 bytes of EEPROM after persistentState
+FixStore fixStore(320);
+// Queued fixes sent in each upload, the number in the current one and
+// the sequence of the first
+const uint8_t UPLOAD_BATCH = 3;
+uint8_t uploadCount = 0;
+uint16_t uploadSequence = 0;
+// The request path "/upload?s=<sequence>&d=<records>", or the datagram
+// with UDP_REPORTS, written in place without String temporaries
+char requestPath[sizeof("/upload?s=65535&d=") + (4 * UPLOAD_BATCH * FIX_RECORD_MAX_SIZE + 2) / 3];
+const char *REPORT_HOST = "whereislolo.herokuapp.com";
+// Sends the uploads as UDP datagrams "s=<sequence>&d=<records>" to
+// UDP_REPORT_PORT instead of HTTP requests, saving the TCP handshake and
+// the HTTP headers. The server acknowledges each datagram with
+// "a=<sequence>", or "a" if it has none. It needs a server listening for
+// UDP, the Heroku backend only takes HTTP
+const bool UDP_REPORTS = false;
+const char *UDP_REPORT_PORT = "5005";
 // Read status
 enum Status {
+	CONFIGURE_GPS,
 	INIT,
 	REMAINING_DATA_REQ_SEND,
 	READ_UNREAD_MESSAGES,
@@ -26,31 +67,120 @@ enum Status {
 	READ_SMS_DATA_QUERY_RESPONSE,
 	SEND_SMS_RESPONSES,
 	READ_GPS,
-	UPLOAD_GPRS
+	UPLOAD_GPRS,
+	RECOVER,
+	SLEEP
 } state;
 
+// Startup state to go on with after an upload or a recovery made during
+// the startup
+Status resumeState = READ_GPS;
+// Whether RECOVER sends the failed upload again once the modem works, or
+// goes on with resumeState
+bool retryUpload = false;
+
 const int GPS_SIGNAL_TIMEOUT = 5000;
 
+// Fixes with HDOP over 5, fewer than 4 satellites or more than 200 km/h
+// away from the previous one are dropped. A fix older than a minute is
+// not uploaded
+FixFilter fixFilter(500, 4, 200, 60 * 1000UL);
+
+// Uploads the positions smoothed by kalmanSmoother instead of the raw ones
+const bool SMOOTH_POSITIONS = true;
+KalmanSmoother kalmanSmoother(200);
+
+// Reporting thresholds: 100 m, 30 degrees while faster than 5 km/h, or
+// a heartbeat each 10 minutes
+ReportPolicy reportPolicy(100, 30, 10 * 60 * 1000UL, 5);
+
+// Fixes within 25 m of the dead reckoning prediction are not uploaded
+TrackCompressor trackCompressor(25, 5 * 60 * 1000UL);
+
 const char *smsNumber = "+59899389599";
 
+// Geofence zones, coordinates in ten millionths of a degree
+const PROGMEM GeofencePoint DEPOT_VERTICES[] = {
+	{ -348812000, -561712000 },
+	{ -348812000, -561688000 },
+	{ -348796000, -561688000 },
+	{ -348796000, -561712000 }
+};
+
+const PROGMEM GeofenceZone GEOFENCE_ZONES[] = {
+	// Depot yard
+	{ 1, 4, 0, { 0, 0 }, { -348812000, -561712000 }, { -348796000, -561688000 }, DEPOT_VERTICES },
+	// 300 m around the office
+	{ 2, 0, 300, { -349058000, -561913000 }, { 0, 0 }, { 0, 0 }, NULL }
+};
+
+void geofenceCallback(void *data, uint8_t zoneId, bool entered);
+Geofence geofence(GEOFENCE_ZONES, sizeof(GEOFENCE_ZONES) / sizeof(GEOFENCE_ZONES[0]), geofenceCallback, NULL);
+
+// Set when a zone was entered or left, the fix is uploaded right away
+bool geofenceEvent = false;
+
 Timer gpsSignalTimeout;
 
+// Sleeps between heartbeats once the vehicle stood still for STILL_TIME.
+// The modem needs about 30 s to register and set up the PDP context
+// again, and the receiver a few seconds to get a fix out of standby
+const bool DUTY_CYCLE = true;
+const unsigned long STILL_TIME = 60 * 1000UL;
+PowerManager powerManager(gprs, gpsConfig, true, 45 * 1000UL, 60 * 1000UL);
+// Restarted by each fix faster than 5 km/h
+Timer stillTimer;
+
+// Failed uploads are retried after 5 s, doubling up to 5 minutes, with
+// the fix getting more drastic as failures pile up. Set MODEM_POWER_PIN
+// to the pin switching the modem supply if one is wired, otherwise the
+// last resort is a reset with AT+CFUN=1,1
+const uint8_t MODEM_POWER_PIN = Recovery::NO_POWER_PIN;
+Recovery recovery(gprs, MODEM_POWER_PIN, 5000, 5 * 60 * 1000UL);
+
+// Last fix, server address, PDP context and modem baud rate kept across
+// resets, in 8 slots of 37 bytes at the start of the EEPROM
+PersistentState persistentState(0, 8);
+// Each save wears a slot, so unless something important changed the
+// state is saved at most each PERSIST_INTERVAL
+const unsigned long PERSIST_INTERVAL = 5 * 60 * 1000UL;
+Timer persistTimer;
+// The persisted address expiry needs the GPS time, so it is handed to
+// gprs with the first fix
+bool addressRestored = false;
+
 void setup()
 {
 	//Initialize serial ports for communication.
 	Serial.begin(9600);
-	cellSerial.begin(9600);
-	gpsSerial.begin(9600);
 	
-	state = INIT;
-	cellSerial.listen();
+	gps.onFix(gpsFixCallback, NULL);
 
 	Serial.println(F("Begin"));
+
+	// A floating analog pin seeds the jitter of the recovery backoff
+	randomSeed(analogRead(0));
+	recovery.begin();
+	gprs.setBaudRate(MODEM_BAUD_RATE, 9600);
+	if (persistentState.load())
+	{
+		restoreState();
+	}
+	persistTimer.setTimeout(PERSIST_INTERVAL);
+	stillTimer.setTimeout(STILL_TIME);
+	fixStore.begin(persistentState.data.queueTail);
+
+	// Opens gpsSerial
+	gpsConfig.begin();
+	state = CONFIGURE_GPS;
 }
 
 void loop() {
 	switch (state)
 	{
+	case(CONFIGURE_GPS):
+		configureGPSLoop();
+		break;
 	case(INIT):
 		initGPRS();
 		break;
@@ -66,9 +196,16 @@ void loop() {
 	case(UPLOAD_GPRS):
 		uploadGPRSLoop();
 		break;
+	case(RECOVER):
+		recoverLoop();
+		break;
+	case(SLEEP):
+		sleepLoop();
+		break;
 	default:
 		break;
 	}
+	fixStore.loop();
 	anyStateLoop();
 }
 
@@ -76,31 +213,115 @@ void dead()
 {
 }
 
-void initGPRS()
+void configureGPSLoop()
+{
+	gpsConfig.loop();
+
+	if (gpsConfig.isDone())
+	{
+		auto error = gpsConfig.getLastError();
+		if (error != GPSConfig::NO_ERROR)
+		{
+			Serial.print(F("<<GPS config error: "));
+			Serial.print(error, 10);
+			Serial.println(F(">>"));
+		}
+		Serial.println(F("GPS ready"));
+
+		state = INIT;
+	}
+}
+
+// While the modem starts up the GPS is read whenever no answer is
+// expected from the modem, so a fix is ready as soon as the modem is
+void startupLoop()
 {
+	if (gprs.isExpectingResponse())
+	{
+		cellSerial.listen();
+	}
+	else
+	{
+		gpsSerial.listen();
+		while (gpsSerial.available() > 0)
+		{
+			gps.encode(gpsSerial.read());
+		}
+	}
+
 	gprs.loop();
+}
 
-	if (gprs.readyForCommands())
+// Goes on with the startup, but uploads first a fix that is ready so the
+// first position does not wait for the SMS traffic
+void startupStep(Status next)
+{
+	if (fixReady)
 	{
-		Serial.println(F("GPRS Module ready"));
+		fixReady = false;
+		resumeState = next;
+		displayGPSInfo();
+		queueFix();
+		uploadGPRS();
+		return;
+	}
+
+	switch (next)
+	{
+	case(REMAINING_DATA_REQ_SEND):
 		sendRemainingDataMessage();
+		break;
+	case(READ_UNREAD_MESSAGES):
+		readUnreadMessages();
+		break;
+	default:
+		readGPS();
+		break;
+	}
+}
+
+void initGPRS()
+{
+	startupLoop();
+
+	// A failed PDP context setup leaves gprs not ready, with the error set
+	auto error = gprs.getLastError();
+	if (error != GPRS::NO_ERROR)
+	{
+		startupFailed(error, REMAINING_DATA_REQ_SEND);
+	}
+	else if (gprs.readyForCommands())
+	{
+		Serial.println(F("GPRS Module ready"));
+		recovery.succeeded();
+		startupStep(REMAINING_DATA_REQ_SEND);
 	}
 }
 
 void sendRemainingDataMessage()
 {
-	gprs.sendSMS("226", "saldo");
+	auto error = gprs.sendSMS("226", "saldo");
+	if (error != GPRS::NO_ERROR)
+	{
+		startupFailed(error, READ_UNREAD_MESSAGES);
+		return;
+	}
 	state = REMAINING_DATA_REQ_SEND;
 }
 
 void remainingDataReqSendLoop()
 {
-	gprs.loop();
+	startupLoop();
 
-	if (gprs.readyForCommands())
+	auto error = gprs.getLastError();
+	if (error != GPRS::NO_ERROR)
+	{
+		startupFailed(error, READ_UNREAD_MESSAGES);
+	}
+	else if (gprs.readyForCommands())
 	{
 		Serial.println(F("Finish sending message"));
-		readUnreadMessages();
+		startupStep(READ_UNREAD_MESSAGES);
 	}
 }
 
@@ -113,18 +334,28 @@ void unreadMessagesCallback(void *data, const String &number, const String &mess
 
 void readUnreadMessages()
 {
-	gprs.receiveUnreadMessages(unreadMessagesCallback, NULL);
+	auto error = gprs.receiveUnreadMessages(unreadMessagesCallback, NULL);
+	if (error != GPRS::NO_ERROR)
+	{
+		startupFailed(error, READ_GPS);
+		return;
+	}
 	state = READ_UNREAD_MESSAGES;
 }
 
 void readUnreadMessagesLoop()
 {
-	gprs.loop();
+	startupLoop();
 
-	if (gprs.readyForCommands())
+	auto error = gprs.getLastError();
+	if (error != GPRS::NO_ERROR)
+	{
+		startupFailed(error, READ_GPS);
+	}
+	else if (gprs.readyForCommands())
 	{
 		Serial.println(F("Finish reading messages"));
-		readGPS();
+		startupStep(READ_GPS);
 	}
 }
 
@@ -158,38 +389,174 @@ inline void readGPSLoop()
 {
 	if (gpsSignalTimeout.wasExpired())
 	{
+		if (!reportPolicy.heartbeatDue())
+		{
+			gpsSignalTimeout.setTimeout(GPS_SIGNAL_TIMEOUT);
+			return;
+		}
 		Serial.println(F("<<GPSSignalTimeout>>"));
 		uploadGPRS();
 		return;
 	}
 
-	if (gpsSerial.available() > 0)
+	// At 5 Hz a char per loop would not keep up with the receiver
+	while (gpsSerial.available() > 0 && !fixReady)
 	{
-		bool gotSentence = gps.encode(gpsSerial.read());
-		if (!gotSentence)
-		{
-			return;
-		}
-		bool validGPSSentence = gps.location.isValid() && gps.date.isValid();
-		if (!validGPSSentence)
-		{
-			return;
-		}
+		gps.encode(gpsSerial.read());
+	}
+
+	if (fixReady)
+	{
+		fixReady = false;
 		displayGPSInfo();
+		queueFix();
 		uploadGPRS();
 	}
+	else if (DUTY_CYCLE && stillTimer.wasExpired() && fixStore.count() == 0 &&
+		powerManager.sleep(reportPolicy.timeToHeartbeat()))
+	{
+		state = SLEEP;
+	}
+}
+
+void sleepLoop()
+{
+	powerManager.loop();
+
+	if (powerManager.isAwake())
+	{
+		stillTimer.setTimeout(STILL_TIME);
+		readGPS();
+	}
+}
+
+void gpsFixCallback(void *data, const TinyGPSFix &fix)
+{
+	bool validGPSSentence = fix.isValid(TinyGPSFix::LOCATION | TinyGPSFix::DATE);
+	if (!validGPSSentence || !fix.isUpdated(TinyGPSFix::LOCATION))
+	{
+		return;
+	}
+
+	FixFilter::Result result = fixFilter.check(fix);
+	if (result != FixFilter::ACCEPTED)
+	{
+		Serial.print(F("<<Fix rejected: "));
+		Serial.print(result);
+		Serial.println(F(">>"));
+		return;
+	}
+	lastFix = fix;
+	if (fix.isValid(TinyGPSFix::SPEED) && fix.speed * 1852L / 100000L >= 5)
+	{
+		stillTimer.setTimeout(STILL_TIME);
+	}
+	if (!addressRestored)
+	{
+		restoreAddress(fix);
+	}
+	if (SMOOTH_POSITIONS)
+	{
+		kalmanSmoother.update(fix);
+	}
+
+	geofence.update(fix);
+	if (geofenceEvent || shouldUploadFix(fix))
+	{
+		fixReady = true;
+	}
+}
+
+inline bool shouldUploadFix(const TinyGPSFix &fix)
+{
+	if (!reportPolicy.shouldReport(fix))
+	{
+		return false;
+	}
+	return reportPolicy.heartbeatDue() || trackCompressor.isKeyPoint(fix);
+}
+
+void geofenceCallback(void *data, uint8_t zoneId, bool entered)
+{
+	Serial.print(entered ? F("<<Entered zone ") : F("<<Left zone "));
+	Serial.print(zoneId);
+	Serial.println(F(">>"));
+	geofenceEvent = true;
+}
+
+void queueFix()
+{
+	FixRecord fix = currentFixRecord();
+	if (fix.flags & FixRecord::NO_POSITION)
+	{
+		return;
+	}
+	if (!fixStore.append(fix))
+	{
+		Serial.println(F("<<Fix store busy>>"));
+	}
 }
 
 inline void uploadGPRS()
 {
-	requestPath = "/upload?lat=" +
-		String(gps.location.lat(), 6) +
-		"&lng=" +
-		String(gps.location.lng(), 6) +
-		"&time=" +
-		String(gps.time.value(), DEC);
+	geofenceEvent = false;
+	reportPolicy.reported(lastFix);
+	trackCompressor.reported(lastFix);
+
+	// Sends the oldest queued fixes, or the current state if none is queued
+	FixRecord fixes[UPLOAD_BATCH];
+	uploadCount = fixStore.peekBatch(fixes, UPLOAD_BATCH, uploadSequence);
+	uint8_t fixCount = uploadCount;
+	if (fixCount == 0)
+	{
+		fixes[0] = currentFixRecord();
+		fixCount = 1;
+	}
+
+	// Each record is relative to the previous one, as the server decodes
+	// them. The last one is acknowledged when the upload succeeds
+	uint8_t records[UPLOAD_BATCH * FIX_RECORD_MAX_SIZE];
+	size_t recordsLength = 0;
+	for (uint8_t i = 0; i < fixCount; ++i)
+	{
+		if (i > 0)
+		{
+			fixEncoder.acknowledge();
+		}
+		recordsLength += fixEncoder.encode(fixes[i], records + recordsLength);
+	}
+
+	// s is the sequence of the first record, the server drops fixes it got
+	char *path = requestPath;
+	if (!UDP_REPORTS)
+	{
+		strcpy_P(path, PSTR("/upload?"));
+		path += strlen(path);
+	}
+	if (uploadCount > 0)
+	{
+		strcpy_P(path, PSTR("s="));
+		ultoa(uploadSequence, path + 2, 10);
+		path += strlen(path);
+		*path++ = '&';
+	}
+	strcpy_P(path, PSTR("d="));
+	base64UrlEncode(records, recordsLength, path + 2);
 
-	gprs.beginRequest("whereislolo.herokuapp.com", requestPath.c_str());
+	GPRS::Error error;
+	if (UDP_REPORTS)
+	{
+		error = gprs.sendDatagram(REPORT_HOST, UDP_REPORT_PORT, requestPath);
+	}
+	else
+	{
+		error = gprs.beginRequest(REPORT_HOST, requestPath);
+	}
+	if (error != GPRS::NO_ERROR)
+	{
+		uploadFailed(error);
+		return;
+	}
 
 	cellSerial.listen();
 	state = UPLOAD_GPRS;
@@ -199,56 +566,252 @@ inline void uploadGPRSLoop()
 {
 	gprs.loop();
 
-	if (gprs.readyForCommands())
+	// A failed PDP context setup leaves gprs not ready, with the error set.
+	// So does an HTTP response without a 2xx status, the queued fixes are
+	// only dropped once the server took them
+	auto error = gprs.getLastError();
+	if (error != GPRS::NO_ERROR)
 	{
-		auto error = gprs.getLastError();
-		if (error == GPRS::NO_ERROR)
+		uploadFailed(error);
+	}
+	else if (gprs.readyForCommands())
+	{
+		if (UDP_REPORTS && !isAcknowledged())
 		{
-			Serial.println(F("<<<DONE>>>"));
+			uploadFailed(GPRS::NO_REPLY);
+			return;
 		}
-		else
+
+		// The 2xx status or the datagram acknowledge tells the server
+		// decoded the records, only now the base moves past them
+		fixEncoder.acknowledge();
+		fixStore.commit(uploadCount);
+		recovery.succeeded();
+		Serial.println(F("<<<DONE>>>"));
+		persistState();
+
+		Status next = resumeState;
+		resumeState = READ_GPS;
+		startupStep(next);
+	}
+}
+
+// The reply to a datagram has to acknowledge the fixes it carried, an
+// acknowledge of the previous upload may come late
+bool isAcknowledged()
+{
+	const char *reply = gprs.getReply();
+	if (uploadCount == 0)
+	{
+		return strcmp(reply, "a") == 0;
+	}
+	return strncmp(reply, "a=", 2) == 0 && reply[2] != '\0' &&
+		(uint16_t)atol(reply + 2) == uploadSequence;
+}
+
+void uploadFailed(GPRS::Error error)
+{
+	// The server may have decoded the upload even though it failed here,
+	// then its base is no longer the one the encoder has. A batch was also
+	// acknowledged in the encoder as it was built. The next upload starts
+	// over with a KEY record either way
+	fixEncoder.reset();
+	retryUpload = true;
+	recover(error);
+}
+
+// The SMS traffic is not needed to track, so a failed startup step is not
+// tried again. Once the modem works the startup goes on with next
+void startupFailed(GPRS::Error error, Status next)
+{
+	resumeState = next;
+	retryUpload = false;
+	recover(error);
+}
+
+void recover(GPRS::Error error)
+{
+	Serial.print(F("<<ERROR: "));
+	Serial.print(error, 10);
+	Serial.println(F(">>"));
+
+	recovery.failed(error);
+	state = RECOVER;
+}
+
+// Keeps reading the GPS while the recovery backs off and fixes the modem,
+// then uploads what was queued meanwhile or goes on with the startup
+void recoverLoop()
+{
+	startupLoop();
+	recovery.loop();
+
+	if (fixReady)
+	{
+		fixReady = false;
+		displayGPSInfo();
+		queueFix();
+	}
+
+	if (recovery.isReady())
+	{
+		if (retryUpload)
 		{
-			Serial.print(F("<<ERROR: "));
-			Serial.print(error, 10);
-			Serial.println(F(">>"));
+			uploadGPRS();
+			return;
 		}
-		
-		readGPS();
+
+		Status next = resumeState;
+		resumeState = READ_GPS;
+		startupStep(next);
 	}
 }
 
+void restoreState()
+{
+	const PersistentState::Data &data = persistentState.data;
+	Serial.println(F("<<State restored>>"));
+
+	// The time is the one of the last fix, which is close enough after a
+	// brown-out on ignition
+	if (data.fixTime != 0)
+	{
+		gpsConfig.setReferencePosition(data.lat, data.lng, data.altitude, data.fixTime);
+	}
+	gprs.assumeConfigured(data.pdpChecksum);
+	if (data.modemBaudRate != 0)
+	{
+		gprs.setBaudRate(MODEM_BAUD_RATE, data.modemBaudRate);
+	}
+}
+
+void restoreAddress(const TinyGPSFix &fix)
+{
+	addressRestored = true;
+
+	unsigned char ip[4];
+	unsigned long ttl;
+	const PersistentState::Data &data = persistentState.data;
+	if (!gprs.getAddress(ip, ttl) && data.ipExpiry > fix.epoch)
+	{
+		gprs.setAddress(data.ip, data.ipExpiry - fix.epoch);
+	}
+}
+
+// Saves the state right away if the address or the PDP context changed,
+// otherwise once PERSIST_INTERVAL elapsed
+void persistState()
+{
+	PersistentState::Data &data = persistentState.data;
+	bool changed = data.pdpChecksum != gprs.configurationChecksum();
+	data.pdpChecksum = gprs.configurationChecksum();
+	changed = changed || data.modemBaudRate != gprs.getBaudRate();
+	data.modemBaudRate = gprs.getBaudRate();
+	data.queueHead = fixStore.head();
+	data.queueTail = fixStore.tail();
+
+	if (lastFix.isValid(TinyGPSFix::LOCATION | TinyGPSFix::DATE | TinyGPSFix::TIME))
+	{
+		data.lat = GeoMath::toE7(lastFix.rawLat);
+		data.lng = GeoMath::toE7(lastFix.rawLng);
+		data.altitude = lastFix.altitude / 100;
+		data.fixTime = lastFix.epoch;
+
+		unsigned char ip[4];
+		unsigned long ttl;
+		if (gprs.getAddress(ip, ttl))
+		{
+			changed = changed || memcmp(data.ip, ip, sizeof(ip)) != 0;
+			memcpy(data.ip, ip, sizeof(ip));
+			data.ipExpiry = lastFix.epoch + ttl;
+		}
+	}
+
+	if (changed || persistTimer.wasExpired())
+	{
+		persistentState.save();
+		persistTimer.setTimeout(PERSIST_INTERVAL);
+	}
+}
+
+FixRecord currentFixRecord()
+{
+	FixRecord fix;
+	if (!lastFix.isValid(TinyGPSFix::LOCATION | TinyGPSFix::DATE | TinyGPSFix::TIME) ||
+		fixFilter.isStale(lastFix))
+	{
+		fix.flags = FixRecord::NO_POSITION;
+		return fix;
+	}
+
+	if (SMOOTH_POSITIONS && kalmanSmoother.isValid())
+	{
+		fix.lat = kalmanSmoother.lat();
+		fix.lng = kalmanSmoother.lng();
+	}
+	else
+	{
+		fix.lat = GeoMath::toE7(lastFix.rawLat);
+		fix.lng = GeoMath::toE7(lastFix.rawLng);
+	}
+	fix.time = lastFix.epoch;
+
+	if (lastFix.isValid(TinyGPSFix::ALTITUDE))
+	{
+		fix.flags |= FixRecord::HAS_ALTITUDE;
+		fix.altitude = lastFix.altitude / 100;
+	}
+
+	if (lastFix.isValid(TinyGPSFix::SPEED | TinyGPSFix::COURSE))
+	{
+		fix.flags |= FixRecord::HAS_MOTION;
+		// Knots * 100 to km/h
+		long speed = lastFix.speed * 1852L / 100000L;
+		fix.speed = speed > 255 ? 255 : speed;
+		fix.course = lastFix.course / 200;
+	}
+
+	return fix;
+}
+
 String getGPSInfo()
 {
-	return String(gps.location.lat(), 6) + ',' + String(gps.location.lng(), 6) + 'D' +
-		gps.date.value() + 'T' + gps.time.value();
+	return String(lastFix.lat(), 6) + ',' + String(lastFix.lng(), 6) + 'T' +
+		String(lastFix.epoch);
 }
 
 void displayGPSInfo()
 {
 	Serial.print(F("Location: "));
-	Serial.print(gps.location.lat(), 6);
+	Serial.print(lastFix.lat(), 6);
 	Serial.print(F(","));
-	Serial.print(gps.location.lng(), 6);
+	Serial.print(lastFix.lng(), 6);
+	if (SMOOTH_POSITIONS && kalmanSmoother.isValid())
+	{
+		Serial.print(F(" +/- "));
+		Serial.print(kalmanSmoother.uncertainty());
+		Serial.print(F(" m"));
+	}
 
 	Serial.print(F("  Date/Time: "));
-	Serial.print(gps.date.month());
+	Serial.print(lastFix.month());
 	Serial.print(F("/"));
-	Serial.print(gps.date.day());
+	Serial.print(lastFix.day());
 	Serial.print(F("/"));
-	Serial.print(gps.date.year());
+	Serial.print(lastFix.year());
 
 	Serial.print(F(" "));
-	if (gps.time.hour() < 10) Serial.print(F("0"));
-	Serial.print(gps.time.hour());
+	if (lastFix.hour() < 10) Serial.print(F("0"));
+	Serial.print(lastFix.hour());
 	Serial.print(F(":"));
-	if (gps.time.minute() < 10) Serial.print(F("0"));
-	Serial.print(gps.time.minute());
+	if (lastFix.minute() < 10) Serial.print(F("0"));
+	Serial.print(lastFix.minute());
 	Serial.print(F(":"));
-	if (gps.time.second() < 10) Serial.print(F("0"));
-	Serial.print(gps.time.second());
+	if (lastFix.second() < 10) Serial.print(F("0"));
+	Serial.print(lastFix.second());
 	Serial.print(F("."));
-	if (gps.time.centisecond() < 10) Serial.print(F("0"));
-	Serial.print(gps.time.centisecond());
+	if (lastFix.centisecond() < 10) Serial.print(F("0"));
+	Serial.print(lastFix.centisecond());
 
 	Serial.println();
 }
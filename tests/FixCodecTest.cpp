@@ -0,0 +1,291 @@
+// FixCodecTest.cpp
+//
+// Round trips records through FixEncoder and FixDecoder, as the tracker
+// and the server use them.
+
+#include <string.h>
+
+#include "FixCodec.h"
+#include "TestUtil.h"
+
+static FixRecord makeFix(int32_t lat, int32_t lng, uint32_t time)
+{
+	FixRecord fix;
+	fix.lat = lat;
+	fix.lng = lng;
+	fix.time = time;
+	return fix;
+}
+
+// Decoded must hold what was encoded. Fields that were not sent keep the
+// value of base, the last record the decoder got
+static void checkSame(const FixRecord &encoded, const FixRecord &decoded, const FixRecord &base)
+{
+	CHECK((decoded.flags & ~FixRecord::KEY) == (encoded.flags & ~FixRecord::KEY));
+	if (encoded.flags & FixRecord::NO_POSITION)
+	{
+		return;
+	}
+	CHECK(decoded.lat == encoded.lat);
+	CHECK(decoded.lng == encoded.lng);
+	CHECK(decoded.time == encoded.time);
+
+	bool key = decoded.flags & FixRecord::KEY;
+	CHECK(decoded.altitude == ((encoded.flags & FixRecord::HAS_ALTITUDE) ?
+		encoded.altitude : key ? 0 : base.altitude));
+	CHECK(decoded.speed == ((encoded.flags & FixRecord::HAS_MOTION) ?
+		encoded.speed : key ? 0 : base.speed));
+	CHECK(decoded.course == ((encoded.flags & FixRecord::HAS_MOTION) ?
+		encoded.course : key ? 0 : base.course));
+}
+
+// Encodes fix, decodes it and acknowledges it. Returns the encoded size
+static size_t roundTrip(FixEncoder &encoder, FixDecoder &decoder, const FixRecord &fix, FixRecord &previous)
+{
+	uint8_t buffer[FIX_RECORD_MAX_SIZE];
+	size_t length = encoder.encode(fix, buffer);
+	CHECK(length > 0 && length <= FIX_RECORD_MAX_SIZE);
+
+	FixRecord decoded;
+	CHECK(decoder.decode(buffer, length, decoded) == length);
+	checkSame(fix, decoded, previous);
+
+	// Any shorter prefix is a truncated record
+	for (size_t prefix = 0; prefix < length; ++prefix)
+	{
+		FixDecoder copy = decoder;
+		FixRecord ignored;
+		CHECK(copy.decode(buffer, prefix, ignored) == 0);
+	}
+
+	encoder.acknowledge();
+	if (!(fix.flags & FixRecord::NO_POSITION))
+	{
+		previous = decoded;
+	}
+	return length;
+}
+
+static void testKeyRecords()
+{
+	FixEncoder encoder;
+	uint8_t buffer[FIX_RECORD_MAX_SIZE];
+
+	// The first record and the first after reset() are KEY records
+	size_t length = encoder.encode(makeFix(-348000000, -561000000, 1400000000), buffer);
+	CHECK(buffer[0] & FixRecord::KEY);
+	CHECK((buffer[0] >> 4) == FIX_CODEC_VERSION);
+
+	// A KEY record decodes without history
+	FixDecoder decoder;
+	FixRecord decoded;
+	CHECK(decoder.decode(buffer, length, decoded) == length);
+	CHECK(decoded.lat == -348000000 && decoded.lng == -561000000 && decoded.time == 1400000000);
+
+	encoder.acknowledge();
+	length = encoder.encode(makeFix(-348000100, -561000100, 1400000010), buffer);
+	CHECK(!(buffer[0] & FixRecord::KEY));
+
+	// A delta does not decode without history
+	FixDecoder fresh;
+	CHECK(fresh.decode(buffer, length, decoded) == 0);
+
+	encoder.reset();
+	encoder.encode(makeFix(-348000100, -561000100, 1400000010), buffer);
+	CHECK(buffer[0] & FixRecord::KEY);
+
+	// A KEY flag set by the caller is not trusted
+	encoder.acknowledge();
+	FixRecord fix = makeFix(1, 2, 3);
+	fix.flags = FixRecord::KEY;
+	encoder.encode(fix, buffer);
+	CHECK(!(buffer[0] & FixRecord::KEY));
+
+	// Unknown versions are refused
+	buffer[0] = ((FIX_CODEC_VERSION + 1) << 4) | FixRecord::KEY;
+	CHECK(fresh.decode(buffer, FIX_RECORD_MAX_SIZE, decoded) == 0);
+}
+
+static void testNoPosition()
+{
+	FixEncoder encoder;
+	FixDecoder decoder;
+	FixRecord previous;
+
+	roundTrip(encoder, decoder, makeFix(100, 200, 300), previous);
+
+	FixRecord none;
+	none.flags = FixRecord::NO_POSITION;
+	none.lat = 12345;
+	CHECK(roundTrip(encoder, decoder, none, previous) == 1);
+
+	// The reference did not move, the next delta is against the fix
+	FixRecord fix = makeFix(101, 201, 301);
+	uint8_t buffer[FIX_RECORD_MAX_SIZE];
+	size_t length = encoder.encode(fix, buffer);
+	CHECK(length == 4);
+	FixRecord decoded;
+	CHECK(decoder.decode(buffer, length, decoded) == length);
+	checkSame(fix, decoded, previous);
+}
+
+static void testLargestDeltas()
+{
+	FixEncoder encoder;
+	FixDecoder decoder;
+	FixRecord previous;
+
+	FixRecord low = makeFix(-900000000L, -1800000000L, 0);
+	low.flags = FixRecord::HAS_ALTITUDE | FixRecord::HAS_MOTION;
+	low.altitude = 0;
+	low.speed = 0;
+	low.course = 0;
+
+	// Differences wrap, half the range away is the longest varint
+	FixRecord high = makeFix(900000000L, 1800000000L, 0x80000000UL);
+	high.flags = FixRecord::HAS_ALTITUDE | FixRecord::HAS_MOTION;
+	high.altitude = INT32_MIN;
+	high.speed = 255;
+	high.course = 179;
+
+	roundTrip(encoder, decoder, low, previous);
+	CHECK(roundTrip(encoder, decoder, high, previous) == FIX_RECORD_MAX_SIZE);
+	roundTrip(encoder, decoder, low, previous);
+	roundTrip(encoder, decoder, high, previous);
+
+	high.altitude = INT32_MAX;
+	roundTrip(encoder, decoder, high, previous);
+}
+
+static void testTimeGoingBackwards()
+{
+	FixEncoder encoder;
+	FixDecoder decoder;
+	FixRecord previous;
+
+	roundTrip(encoder, decoder, makeFix(10, 10, 1400000000), previous);
+	roundTrip(encoder, decoder, makeFix(10, 10, 1399999999), previous);
+	roundTrip(encoder, decoder, makeFix(10, 10, 0), previous);
+	roundTrip(encoder, decoder, makeFix(10, 10, UINT32_MAX), previous);
+	roundTrip(encoder, decoder, makeFix(10, 10, 1400000000), previous);
+}
+
+static void testRandomTracks()
+{
+	for (int track = 0; track < 200; ++track)
+	{
+		FixEncoder encoder;
+		FixDecoder decoder;
+		FixRecord previous;
+
+		FixRecord fix = makeFix((int32_t)(nextRandom() % 1800000001UL) - 900000000L,
+			(int32_t)(nextRandom() % 3600000001UL) - 1800000000L, nextRandom());
+		for (int i = 0; i < 500; ++i)
+		{
+			// Mostly small steps, sometimes anything
+			if (nextRandom() % 16)
+			{
+				fix.lat += (int32_t)(nextRandom() % 20001) - 10000;
+				fix.lng += (int32_t)(nextRandom() % 20001) - 10000;
+				fix.time += nextRandom() % 60;
+			}
+			else
+			{
+				fix.lat = (int32_t)nextRandom();
+				fix.lng = (int32_t)nextRandom();
+				fix.time = nextRandom();
+			}
+			fix.flags = nextRandom() & (FixRecord::HAS_ALTITUDE | FixRecord::HAS_MOTION);
+			if (nextRandom() % 32 == 0)
+			{
+				fix.flags |= FixRecord::NO_POSITION;
+			}
+			fix.altitude = (int32_t)(nextRandom() % 9000) - 500;
+			fix.speed = nextRandom() % 256;
+			fix.course = nextRandom() % 180;
+
+			roundTrip(encoder, decoder, fix, previous);
+		}
+	}
+}
+
+// The server got an upload the tracker saw failing. After reset() the next
+// record still decodes on the server
+static void testAmbiguousFailure()
+{
+	FixEncoder encoder;
+	FixDecoder decoder;
+	FixRecord previous;
+
+	roundTrip(encoder, decoder, makeFix(1000, 1000, 1000), previous);
+
+	uint8_t buffer[FIX_RECORD_MAX_SIZE];
+	size_t length = encoder.encode(makeFix(2000, 2000, 2000), buffer);
+	FixRecord decoded;
+	CHECK(decoder.decode(buffer, length, decoded) == length);
+
+	encoder.reset();
+	FixRecord fix = makeFix(3000, 3000, 3000);
+	length = encoder.encode(fix, buffer);
+	CHECK(decoder.decode(buffer, length, decoded) == length);
+	checkSame(fix, decoded, previous);
+}
+
+// The server answered an upload with an error and decoded nothing. Had
+// the encoder moved its base, the next delta would not decode
+static void testRejectedUpload()
+{
+	FixEncoder encoder;
+	FixDecoder decoder;
+	FixRecord previous;
+
+	roundTrip(encoder, decoder, makeFix(1000, 1000, 1000), previous);
+
+	uint8_t buffer[FIX_RECORD_MAX_SIZE];
+	encoder.encode(makeFix(2000, 2000, 2000), buffer);
+
+	encoder.reset();
+	FixRecord fix = makeFix(3000, 3000, 3000);
+	size_t length = encoder.encode(fix, buffer);
+	CHECK(buffer[0] & FixRecord::KEY);
+	FixRecord decoded;
+	CHECK(decoder.decode(buffer, length, decoded) == length);
+	checkSame(fix, decoded, previous);
+
+	// Without the reset the delta is against the rejected record
+	FixEncoder stale;
+	FixDecoder server;
+	FixRecord ignored;
+	roundTrip(stale, server, makeFix(1000, 1000, 1000), ignored);
+	stale.encode(makeFix(2000, 2000, 2000), buffer);
+	stale.acknowledge();
+	length = stale.encode(fix, buffer);
+	CHECK(server.decode(buffer, length, decoded) == length);
+	CHECK(decoded.lat != fix.lat);
+}
+
+static void testBase64Url()
+{
+	char out[16];
+	const uint8_t data[] = { 0xFB, 0xFF, 0xBF, 'a', 'b' };
+
+	CHECK(base64UrlEncode(data, 0, out) == 0 && strcmp(out, "") == 0);
+	CHECK(base64UrlEncode(data, 1, out) == 2 && strcmp(out, "-w") == 0);
+	CHECK(base64UrlEncode(data, 2, out) == 3 && strcmp(out, "-_8") == 0);
+	CHECK(base64UrlEncode(data, 3, out) == 4 && strcmp(out, "-_-_") == 0);
+	CHECK(base64UrlEncode(data, 5, out) == 7 && strcmp(out, "-_-_YWI") == 0);
+}
+
+int main()
+{
+	testKeyRecords();
+	testNoPosition();
+	testLargestDeltas();
+	testTimeGoingBackwards();
+	testRandomTracks();
+	testAmbiguousFailure();
+	testRejectedUpload();
+	testBase64Url();
+
+	return testResult();
+}
@@ -0,0 +1,123 @@
+// GeoMathTest.cpp
+//
+// Compares GeoMath::Reference::distanceTo() with
+// TinyGPSPlus::distanceBetween(), in accuracy and in speed.
+
+#include <chrono>
+
+#include "GeoMath.h"
+#include "TestUtil.h"
+
+unsigned long millis()
+{
+	return 0;
+}
+
+// Random point about distance meters away from lat, lng
+static void offset(double lat, double lng, double distance, double &toLat, double &toLng)
+{
+	double bearing = nextRandom(0, TWO_PI);
+	double angle = distance / 6372795;
+	toLat = lat + degrees(angle * cos(bearing));
+	toLng = lng + degrees(angle * sin(bearing) / cos(radians(lat)));
+	if (toLng > 180.0)
+	{
+		toLng -= 360.0;
+	}
+	else if (toLng < -180.0)
+	{
+		toLng += 360.0;
+	}
+}
+
+static void testAccuracy()
+{
+	double worstError = 0;
+	double worstRatio = 0;
+
+	for (int i = 0; i < 200000; ++i)
+	{
+		double lat = nextRandom(-70, 70);
+		double lng = nextRandom(-180, 180);
+		double toLat, toLng;
+		offset(lat, lng, nextRandom(0, GeoMath::MAX_FLAT_DISTANCE), toLat, toLng);
+
+		GeoMath::Reference reference(lat, lng);
+		double fast = reference.distanceTo(toLat, toLng);
+		double exact = TinyGPSPlus::distanceBetween(lat, lng, toLat, toLng);
+		if (fast > GeoMath::MAX_FLAT_DISTANCE)
+		{
+			// Fell back to the great circle
+			CHECK(fast == exact);
+			continue;
+		}
+
+		double error = fabs(fast - exact);
+		if (error > worstError)
+		{
+			worstError = error;
+		}
+		if (exact > 1.0 && error / exact > worstRatio)
+		{
+			worstRatio = error / exact;
+		}
+	}
+
+	printf("Worst error up to %.0f m: %.2f m, %.3f%%\n",
+		GeoMath::MAX_FLAT_DISTANCE, worstError, 100 * worstRatio);
+	CHECK(worstRatio < 0.001);
+	CHECK(worstError < 0.001 * GeoMath::MAX_FLAT_DISTANCE);
+}
+
+static void testFarPoints()
+{
+	GeoMath::Reference reference(-34.9, -56.2);
+	CHECK(reference.distanceTo(-34.6, -58.4) ==
+		TinyGPSPlus::distanceBetween(-34.9, -56.2, -34.6, -58.4));
+
+	// Across the antimeridian the short way round is taken
+	GeoMath::Reference antimeridian(0, 179.99);
+	double distance = antimeridian.distanceTo(0, -179.99);
+	CHECK(fabs(distance - TinyGPSPlus::distanceBetween(0, 179.99, 0, -179.99)) < 1.0);
+	CHECK(distance < 2300);
+}
+
+// Distances from one reference, as ReportPolicy measures them
+static void benchmark()
+{
+	const int COUNT = 1000000;
+	static double lats[1024], lngs[1024];
+	for (int i = 0; i < 1024; ++i)
+	{
+		offset(-34.9, -56.2, nextRandom(0, GeoMath::MAX_FLAT_DISTANCE), lats[i], lngs[i]);
+	}
+
+	GeoMath::Reference reference(-34.9, -56.2);
+	double sum = 0;
+
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < COUNT; ++i)
+	{
+		sum += reference.distanceTo(lats[i & 1023], lngs[i & 1023]);
+	}
+	auto middle = std::chrono::steady_clock::now();
+	for (int i = 0; i < COUNT; ++i)
+	{
+		sum -= TinyGPSPlus::distanceBetween(-34.9, -56.2, lats[i & 1023], lngs[i & 1023]);
+	}
+	auto end = std::chrono::steady_clock::now();
+
+	double fast = std::chrono::duration<double, std::nano>(middle - start).count() / COUNT;
+	double exact = std::chrono::duration<double, std::nano>(end - middle).count() / COUNT;
+	printf("distanceTo %.1f ns, distanceBetween %.1f ns, %.1fx (checksum %.0f)\n",
+		fast, exact, exact / fast, sum);
+}
+
+int main()
+{
+	testAccuracy();
+	testFarPoints();
+	benchmark();
+
+	return testResult();
+}
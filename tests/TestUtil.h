@@ -0,0 +1,50 @@
+// TestUtil.h
+//
+// Checks and random numbers shared by the host tests.
+
+#ifndef _TESTUTIL_h
+#define _TESTUTIL_h
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Failed checks so far, main() returns non zero if any
+static int failures = 0;
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+			++failures; \
+		} \
+	} while (0)
+
+// Deterministic, so a failure can be reproduced
+static uint32_t randomState = 2463534242UL;
+
+static uint32_t nextRandom()
+{
+	randomState ^= randomState << 13;
+	randomState ^= randomState >> 17;
+	randomState ^= randomState << 5;
+	return randomState;
+}
+
+// Uniform in [low, high]
+static double nextRandom(double low, double high)
+{
+	return low + (high - low) * (nextRandom() / 4294967295.0);
+}
+
+static int testResult()
+{
+	if (failures)
+	{
+		printf("%d checks failed\n", failures);
+		return 1;
+	}
+	printf("All checks passed\n");
+	return 0;
+}
+
+#endif
@@ -0,0 +1,345 @@
+// TinyGPSParserTest.cpp
+//
+// Compares TinyGPSPlus::parseDecimal() and parseDegrees() with the atol()
+// based implementations they replaced, in results and in speed, on a
+// recorded log and on random terms. Takes the path of the log.
+
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "TinyGPS++.h"
+#include "TestUtil.h"
+
+unsigned long millis()
+{
+	return 0;
+}
+
+// TinyGPS++ 0.95 parseDecimal()
+static int32_t oldParseDecimal(const char *term)
+{
+	bool negative = *term == '-';
+	if (negative) ++term;
+	int32_t ret = 100 * (int32_t)atol(term);
+	while (isdigit(*term)) ++term;
+	if (*term == '.' && isdigit(term[1]))
+	{
+		ret += 10 * (term[1] - '0');
+		if (isdigit(term[2]))
+			ret += term[2] - '0';
+	}
+	return negative ? -ret : ret;
+}
+
+// TinyGPS++ 0.95 parseDegrees()
+static void oldParseDegrees(const char *term, RawDegrees &deg)
+{
+	uint32_t leftOfDecimal = (uint32_t)atol(term);
+	uint16_t minutes = (uint16_t)(leftOfDecimal % 100);
+	uint32_t multiplier = 10000000UL;
+	uint32_t tenMillionthsOfMinutes = minutes * multiplier;
+
+	deg.deg = (int16_t)(leftOfDecimal / 100);
+
+	while (isdigit(*term))
+		++term;
+
+	if (*term == '.')
+		while (isdigit(*++term))
+		{
+			multiplier /= 10;
+			tenMillionthsOfMinutes += (*term - '0') * multiplier;
+		}
+
+	deg.billionths = (5 * tenMillionthsOfMinutes + 1) / 3;
+	deg.negative = false;
+}
+
+static void appendDigits(std::string &term, int count)
+{
+	for (int i = 0; i < count; ++i)
+	{
+		term += (char)('0' + nextRandom() % 10);
+	}
+}
+
+// A term as a receiver sends it, sometimes cut short or followed by
+// garbage. Terms atol() reads differently from NMEA are left out: leading
+// blanks or '+', and whole parts that overflow 100 * int32_t
+static std::string randomTerm(bool sign)
+{
+	static const char garbage[] = ".-A*";
+
+	std::string term;
+	if (sign && nextRandom() % 4 == 0)
+	{
+		term += '-';
+	}
+	appendDigits(term, nextRandom() % 8);
+	if (nextRandom() % 4)
+	{
+		term += '.';
+		appendDigits(term, nextRandom() % 10);
+	}
+	if (nextRandom() % 8 == 0)
+	{
+		for (int i = nextRandom() % 4; i >= 0; --i)
+		{
+			term += garbage[nextRandom() % (sizeof(garbage) - 1)];
+		}
+	}
+	return term;
+}
+
+static void testDecimal()
+{
+	static const char *const terms[] = {
+		"", "-", ".", "-.", "0", "-0", "12", "12.", "12.3", "12.34", "12.345",
+		"-12.34", ".5", "-.5", "1..5", "1.x5", "A", "1A.5", "9999999.99"
+	};
+	for (size_t i = 0; i < sizeof(terms) / sizeof(terms[0]); ++i)
+	{
+		CHECK(TinyGPSPlus::parseDecimal(terms[i]) == oldParseDecimal(terms[i]));
+	}
+
+	for (long i = 0; i < 1000000; ++i)
+	{
+		std::string term = randomTerm(true);
+		int32_t value = TinyGPSPlus::parseDecimal(term.c_str());
+		if (value != oldParseDecimal(term.c_str()))
+		{
+			printf("parseDecimal(\"%s\") = %ld, was %ld\n", term.c_str(),
+				(long)value, (long)oldParseDecimal(term.c_str()));
+			CHECK(false);
+			break;
+		}
+	}
+}
+
+// More decimals than the old parser kept: the fraction is truncated
+static void testDecimalPrecision()
+{
+	CHECK(TinyGPSPlus::parseDecimal("12.3456789", 0) == 12);
+	CHECK(TinyGPSPlus::parseDecimal("12.3456789", 4) == 123456);
+	CHECK(TinyGPSPlus::parseDecimal("-12.3456789", 7) == -123456789);
+	CHECK(TinyGPSPlus::parseDecimal("12.3", 5) == 1230000);
+	CHECK(TinyGPSPlus::parseDecimal("0.0000001", 7) == 1);
+	CHECK(TinyGPSPlus::parseDecimal("1.5", 9) == 15000000);
+
+	// Values past int32_t are clamped instead of wrapping
+	CHECK(TinyGPSPlus::parseDecimal("214.7483647", 7) == INT32_MAX);
+	CHECK(TinyGPSPlus::parseDecimal("214.7483648", 7) == INT32_MAX);
+	CHECK(TinyGPSPlus::parseDecimal("215", 7) == INT32_MAX);
+	CHECK(TinyGPSPlus::parseDecimal("-545.4", 7) == -INT32_MAX);
+	CHECK(TinyGPSPlus::parseDecimal("21474836.47") == INT32_MAX);
+	CHECK(TinyGPSPlus::parseDecimal("21474836.48") == INT32_MAX);
+	CHECK(TinyGPSPlus::parseDecimal("21474836.46") == INT32_MAX - 1);
+	CHECK(TinyGPSPlus::parseDecimal("2147483647", 0) == INT32_MAX);
+	CHECK(TinyGPSPlus::parseDecimal("2147483648", 0) == INT32_MAX);
+	CHECK(TinyGPSPlus::parseDecimal("-2147483640", 0) == -2147483640);
+	CHECK(TinyGPSPlus::parseDecimal("99999999999999999999.9", 1) == INT32_MAX);
+	CHECK(TinyGPSPlus::parseDecimal("213.9999999", 7) == 2139999999);
+}
+
+static void testDegrees()
+{
+	static const char *const terms[] = {
+		"", ".", "0", "5", "12", "123", "3456.7890", "03456.7890", "18000.0000",
+		"3456.12345678901", "3456.", "34A6.78", "3456.7A8", "3456..78"
+	};
+	for (size_t i = 0; i < sizeof(terms) / sizeof(terms[0]); ++i)
+	{
+		RawDegrees value, old;
+		TinyGPSPlus::parseDegrees(terms[i], value);
+		oldParseDegrees(terms[i], old);
+		CHECK(value.deg == old.deg && value.billionths == old.billionths);
+	}
+
+	for (long i = 0; i < 1000000; ++i)
+	{
+		std::string term = randomTerm(false);
+		RawDegrees value, old;
+		TinyGPSPlus::parseDegrees(term.c_str(), value);
+		oldParseDegrees(term.c_str(), old);
+		if (value.deg != old.deg || value.billionths != old.billionths || value.negative)
+		{
+			printf("parseDegrees(\"%s\") = %u %lu, was %u %lu\n", term.c_str(),
+				value.deg, (unsigned long)value.billionths, old.deg, (unsigned long)old.billionths);
+			CHECK(false);
+			break;
+		}
+	}
+}
+
+// The sentences of the log at path
+static std::vector<std::string> readLog(const char *path)
+{
+	std::vector<std::string> sentences;
+	std::ifstream in(path);
+	std::string line;
+	while (std::getline(in, line))
+	{
+		if (!line.empty() && line[line.size() - 1] == '\r')
+		{
+			line.erase(line.size() - 1);
+		}
+		if (!line.empty() && line[0] == '$')
+		{
+			sentences.push_back(line);
+		}
+	}
+	return sentences;
+}
+
+// The terms of a sentence, from its name to the one before the checksum
+static std::vector<std::string> splitTerms(const std::string &sentence)
+{
+	std::vector<std::string> terms;
+	size_t end = sentence.find('*');
+	size_t start = 1;
+	while (true)
+	{
+		size_t comma = sentence.find(',', start);
+		if (comma == std::string::npos || comma > end)
+		{
+			terms.push_back(sentence.substr(start, end - start));
+			return terms;
+		}
+		terms.push_back(sentence.substr(start, comma - start));
+		start = comma + 1;
+	}
+}
+
+static void checkDegrees(const RawDegrees &value, const std::string &term, const std::string &hemisphere)
+{
+	RawDegrees old;
+	oldParseDegrees(term.c_str(), old);
+	CHECK(value.deg == old.deg && value.billionths == old.billionths);
+	CHECK(value.negative == (hemisphere == "S" || hemisphere == "W"));
+}
+
+static int32_t oldDecimal(const std::string &term)
+{
+	return oldParseDecimal(term.c_str());
+}
+
+// Decodes the log with TinyGPSPlus, which accumulates the numbers while
+// the characters arrive, and checks each field against the atol() based
+// parser applied to its term
+static void testRecordedLog(const std::vector<std::string> &sentences)
+{
+	CHECK(!sentences.empty());
+
+	TinyGPSPlus gps;
+	for (size_t i = 0; i < sentences.size(); ++i)
+	{
+		std::vector<std::string> terms = splitTerms(sentences[i]);
+		for (size_t j = 0; j < terms.size(); ++j)
+		{
+			CHECK(TinyGPSPlus::parseDecimal(terms[j].c_str()) == oldDecimal(terms[j]));
+		}
+
+		uint32_t passed = gps.passedChecksum();
+		for (size_t j = 0; j < sentences[i].size(); ++j)
+		{
+			gps.encode(sentences[i][j]);
+		}
+		gps.encode('\r');
+		gps.encode('\n');
+		CHECK(gps.passedChecksum() == passed + 1);
+
+		std::string type = terms[0].substr(2);
+		if (type == "RMC")
+		{
+			CHECK(gps.time.value() == (uint32_t)oldDecimal(terms[1]));
+			checkDegrees(gps.location.rawLat(), terms[3], terms[4]);
+			checkDegrees(gps.location.rawLng(), terms[5], terms[6]);
+			CHECK(gps.speed.value() == oldDecimal(terms[7]));
+			CHECK(gps.course.value() == oldDecimal(terms[8]));
+			CHECK(gps.date.value() == (uint32_t)atol(terms[9].c_str()));
+		}
+		else if (type == "GGA")
+		{
+			CHECK(gps.time.value() == (uint32_t)oldDecimal(terms[1]));
+			checkDegrees(gps.location.rawLat(), terms[2], terms[3]);
+			checkDegrees(gps.location.rawLng(), terms[4], terms[5]);
+			CHECK(gps.satellites.value() == (uint32_t)atol(terms[7].c_str()));
+			CHECK(gps.hdop.value() == oldDecimal(terms[8]));
+			CHECK(gps.altitude.value() == oldDecimal(terms[9]));
+		}
+		else
+		{
+			CHECK(false);
+		}
+	}
+}
+
+// The numeric fields of the log, as TinyGPSPlus decodes them from RMC and
+// GGA. On the host at -Os, the level Arduino builds use, the single pass
+// parsers are no faster than the atol() based ones, at -O2 they are about
+// 1.3x faster. There is no measure on the AVR
+static void benchmark(const std::vector<std::string> &sentences)
+{
+	std::vector<std::string> decimals, degrees;
+	for (size_t i = 0; i < sentences.size(); ++i)
+	{
+		std::vector<std::string> terms = splitTerms(sentences[i]);
+		bool rmc = terms[0].substr(2) == "RMC";
+		const int decimalTerms[2][4] = { { 1, 8, 9, 0 }, { 1, 7, 8, 0 } };
+		for (const int *term = decimalTerms[rmc ? 1 : 0]; *term; ++term)
+		{
+			decimals.push_back(terms[*term]);
+		}
+		degrees.push_back(terms[rmc ? 3 : 2]);
+		degrees.push_back(terms[rmc ? 5 : 4]);
+	}
+	if (decimals.empty())
+	{
+		return;
+	}
+	const long COUNT = 2000000;
+
+	int64_t sum = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (long i = 0; i < COUNT; ++i)
+	{
+		RawDegrees deg;
+		sum += TinyGPSPlus::parseDecimal(decimals[i % decimals.size()].c_str());
+		TinyGPSPlus::parseDegrees(degrees[i % degrees.size()].c_str(), deg);
+		sum += deg.billionths;
+	}
+	auto middle = std::chrono::steady_clock::now();
+	for (long i = 0; i < COUNT; ++i)
+	{
+		RawDegrees deg;
+		sum -= oldParseDecimal(decimals[i % decimals.size()].c_str());
+		oldParseDegrees(degrees[i % degrees.size()].c_str(), deg);
+		sum -= deg.billionths;
+	}
+	auto end = std::chrono::steady_clock::now();
+
+	double parsers = std::chrono::duration<double, std::nano>(middle - start).count() / COUNT;
+	double old = std::chrono::duration<double, std::nano>(end - middle).count() / COUNT;
+	printf("Decimal and degrees: %.1f ns, atol() based %.1f ns, %.1fx\n", parsers, old, old / parsers);
+	CHECK(sum == 0);
+}
+
+int main(int argc, char **argv)
+{
+	if (argc != 2)
+	{
+		printf("Usage: TinyGPSParserTest <recorded.nmea>\n");
+		return 1;
+	}
+	std::vector<std::string> sentences = readLog(argv[1]);
+
+	testRecordedLog(sentences);
+	testDecimal();
+	testDecimalPrecision();
+	testDegrees();
+	benchmark(sentences);
+
+	return testResult();
+}
@@ -0,0 +1,27 @@
+// Arduino.h
+//
+// The part of the Arduino core the host tests build against.
+
+#ifndef _ARDUINO_h
+#define _ARDUINO_h
+
+#include <ctype.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PROGMEM
+#define pgm_read_word(address) (*(const uint16_t *)(address))
+
+#define TWO_PI 6.283185307179586476925286766559
+#define radians(deg) ((deg) * 0.017453292519943295769236907684886)
+#define degrees(rad) ((rad) * 57.295779513082320876798154814105)
+#define sq(x) ((x) * (x))
+
+typedef uint8_t byte;
+
+unsigned long millis();
+
+#endif